@@ -0,0 +1,159 @@
+#include "engine/parallel.h"
+#include "engine/book.h"
+#include "engine/mcts.h"
+
+// Microseconds of every frame the computer gets to think, leaving the rest of the frame for input and drawing
+#define COMPUTER_SLICE_US 8000
+// Frames the computer thinks for before playing the best move it has, about two seconds
+#define COMPUTER_THINK_FRAMES 120
+// Nodes searched between looks at the clock
+#define COMPUTER_NODES_PER_CHECK 256
+// Transposition table size
+#define COMPUTER_TABLE_MB 4
+// Search threads. The 3DS build always runs one, on the main thread.
+#define COMPUTER_THREADS 1
+// Node pool of the Monte Carlo player
+#define COMPUTER_MCTS_MB 2
+// Playouts run between looks at the clock. One takes a millisecond or two on the 3DS.
+#define COMPUTER_PLAYOUTS_PER_CHECK 1
+// Opening book built with the host's book tool. The computer plays without one if it's missing.
+#define COMPUTER_BOOK_PATH "romfs:/book.bin"
+
+struct ComputerState {
+   Color color;
+   // Plays with the Monte Carlo tree search instead of alpha-beta
+   bool montecarlo;
+   bool thinking;
+   u16 frames;
+   // Online: analyse while the opponent thinks (toggled with select)
+   bool ponder;
+   bool pondering;
+   // Opponent move the analysis currently expects
+   Move expectedReply;
+};
+
+ComputerState computerState;
+ParallelSearch computerSearch;
+TranspositionTable computerTable;
+Mcts computerMcts;
+OpeningBook computerBook;
+
+// Allocates the search and its transposition table, once for the whole session. Without the table the computer
+// still plays, only weaker.
+void computerInit() {
+   bool table = initTable(computerTable, COMPUTER_TABLE_MB);
+   if (!initParallelSearch(computerSearch, COMPUTER_THREADS, table ? &computerTable : NULL)
+      || !initMcts(computerMcts, COMPUTER_MCTS_MB)) {
+      failExit("Not enough memory for the computer player\n");
+   }
+   setParallelTablebases(computerSearch, &tablebases);
+   openBook(computerBook, COMPUTER_BOOK_PATH);
+}
+
+// Called every frame in single player. On the computer's turn it searches for a slice of the frame, and plays
+// its move once the search ends or the thinking time is up. Once the game is over it doesn't move.
+void computerUpdate() {
+   if (gameState.playerTurn != computerState.color || game.end != GAME_ONGOING) {
+      return;
+   }
+   if (!computerState.thinking) {
+      // Known openings are played straight from the book, without thinking.
+      Move bookMove = pickBookMove(computerBook, game.board, svcGetSystemTick());
+      if (bookMove) {
+         playMove(bookMove);
+         return;
+      }
+      if (computerState.montecarlo) {
+         startMcts(computerMcts, game.board, 0, svcGetSystemTick());
+      }
+      else {
+         startParallelSearch(computerSearch, game.board, game.history, 0, 0);
+      }
+      computerState.thinking = true;
+      computerState.frames = 0;
+   }
+
+   u64 deadline = svcGetSystemTick() + (u64)COMPUTER_SLICE_US * (SYSCLOCK_ARM11 / 1000000);
+   bool finished;
+   Move move;
+   if (computerState.montecarlo) {
+      while (!continueMcts(computerMcts, COMPUTER_PLAYOUTS_PER_CHECK) && svcGetSystemTick() < deadline) {}
+      if (++computerState.frames >= COMPUTER_THINK_FRAMES) {
+         stopMcts(computerMcts);
+      }
+      finished = computerMcts.finished;
+      move = bestMctsMove(computerMcts);
+   }
+   else {
+      while (!continueParallelSearch(computerSearch, COMPUTER_NODES_PER_CHECK) && svcGetSystemTick() < deadline) {}
+      if (++computerState.frames >= COMPUTER_THINK_FRAMES) {
+         stopParallelSearch(computerSearch);
+      }
+      finished = mainSearch(computerSearch).finished;
+      move = mainSearch(computerSearch).bestMove;
+   }
+   if (finished) {
+      computerState.thinking = false;
+      // No move means the game is over.
+      if (move) {
+         playMove(move);
+      }
+   }
+}
+
+// Generates our legal moves for the position after the reply, so they come from the move cache if it's played.
+void prepareReply(Move reply) {
+   Board after = game.board;
+   Undo undo;
+   makeMove(after, reply, undo);
+   MoveList moves;
+   calculateLegalMoves(after, moves);
+   storeMoveCache(moveCache, after.key, moves, after.colors[after.turn]);
+}
+
+// Online, on the opponent's turn. Searches their position a slice at a time, which leaves a best answer to
+// their likely replies in the table, and prepares our moves after the reply the search expects. Preparing
+// every reply would take a whole frame, and they'd mostly push each other out of the move cache.
+void ponderUpdate() {
+   if (!computerState.ponder) {
+      if (computerState.pondering) {
+         stopParallelSearch(computerSearch);
+         computerState.pondering = false;
+      }
+      return;
+   }
+   if (!computerState.pondering) {
+      startParallelSearch(computerSearch, game.board, game.history, 0, 0);
+      computerState.pondering = true;
+      computerState.expectedReply = MOVE_NONE;
+   }
+
+   Search &search = mainSearch(computerSearch);
+   if (search.finished) {
+      return;
+   }
+   u64 deadline = svcGetSystemTick() + (u64)COMPUTER_SLICE_US * (SYSCLOCK_ARM11 / 1000000);
+   while (!continueParallelSearch(computerSearch, COMPUTER_NODES_PER_CHECK) && svcGetSystemTick() < deadline) {}
+
+   // Another reply may have taken the expected one's slot in the move cache since.
+   if (search.bestMove && search.bestMove != computerState.expectedReply) {
+      computerState.expectedReply = search.bestMove;
+      prepareReply(search.bestMove);
+   }
+}
+
+// Called once the opponent's move is in. Stops the analysis and takes the hint from the table.
+void ponderFinish() {
+   if (!computerState.pondering) {
+      return;
+   }
+   stopParallelSearch(computerSearch);
+   computerState.pondering = false;
+
+   TableEntry entry;
+   TableStats stats;
+   if (computerSearch.table && probeTable(*computerSearch.table, game.board.key, entry, stats) && entry.move
+      && validMove(game, positionOf(moveFrom(entry.move)), positionOf(moveTo(entry.move))) == entry.move) {
+      gameState.hint = entry.move;
+   }
+}
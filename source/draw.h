@@ -12,6 +12,7 @@ struct DrawObject {
    u32 clrGreen;
    u32 clrLightGreen;
    u32 clrDarkBlue;
+   u32 clrLightBlue;
 };
 
 DrawObject drawObject;
@@ -51,6 +52,7 @@ void drawInit() {
    drawObject.clrGreen = C2D_Color32(0x75, 0x83, 0x54, 0xFF);
    drawObject.clrLightGreen = C2D_Color32(0xBE, 0xBA, 0x52, 0xFF);
    drawObject.clrDarkBlue = C2D_Color32(0x5C, 0x4C, 0x5B, 0xFF);
+   drawObject.clrLightBlue = C2D_Color32(0x8C, 0xAE, 0xC8, 0xFF);
    
    initSprites();
 }
@@ -77,8 +79,9 @@ void drawPieces() {
    u8 spriteNum;
    for (s8 i = 0; i < 8; i++) {
       for (s8 j = 0; j < 8; j++) {
-         if (chessBoard[i][j].currentPiece) {
-            spriteNum = (chessBoard[i][j].currentPiece - 1) * 2 + chessBoard[i][j].pieceColor;
+         u8 square = j * 8 + i;
+         if (pieceOn(game.board, square)) {
+            spriteNum = (pieceOn(game.board, square) - 1) * 2 + colorOn(game.board, square);
             // Screen draws from top left, while chessBoard is from bottom left.
             C2D_SpriteSetPos(&sprites[spriteNum], float(40 + i * 30), float(240 - 30 * j));
             C2D_DrawSprite(&sprites[spriteNum]);
@@ -95,16 +98,29 @@ void drawUpdate() {
    drawBoard();
 
    // Highlight the previous move.
-   if (gameState.turns > 0) {
-      C2D_DrawRectSolid(float(40 + gameState.prevMoveStart.column * 30), float(210 - 30 * gameState.prevMoveStart.row), 0.0f, 30.0f, 30.0f, drawObject.clrLightGreen);
-      C2D_DrawRectSolid(float(40 + gameState.prevMoveEnd.column * 30), float(210 - 30 * gameState.prevMoveEnd.row), 0.0f, 30.0f, 30.0f, drawObject.clrLightGreen);
+   if (game.turns > 0) {
+      Position prevMoveStart = positionOf(moveFrom(game.prevMove));
+      Position prevMoveEnd = positionOf(moveTo(game.prevMove));
+      C2D_DrawRectSolid(float(40 + prevMoveStart.column * 30), float(210 - 30 * prevMoveStart.row), 0.0f, 30.0f, 30.0f, drawObject.clrLightGreen);
+      C2D_DrawRectSolid(float(40 + prevMoveEnd.column * 30), float(210 - 30 * prevMoveEnd.row), 0.0f, 30.0f, 30.0f, drawObject.clrLightGreen);
+   }
+
+   // Highlight the hint.
+   if (gameState.hint) {
+      Position hintStart = positionOf(moveFrom(gameState.hint));
+      Position hintEnd = positionOf(moveTo(gameState.hint));
+      C2D_DrawRectSolid(float(40 + hintStart.column * 30), float(210 - 30 * hintStart.row), 0.0f, 30.0f, 30.0f, drawObject.clrLightBlue);
+      C2D_DrawRectSolid(float(40 + hintEnd.column * 30), float(210 - 30 * hintEnd.row), 0.0f, 30.0f, 30.0f, drawObject.clrLightBlue);
    }
 
    // If a piece is currently selected, highlight the spaces it can move to.
    if (gameState.pieceSelected) {      
-      for (u8 i = 0; i < possibleMoves[gameState.selectedPiece.column][gameState.selectedPiece.row].size(); i++) {
+      u8 square = squareOf(gameState.selectedPiece);
+      const MoveList &possibleMoves = game.possibleMoves;
+      for (u16 i = possibleMoves.first[square]; i < possibleMoves.first[square] + possibleMoves.count[square]; i++) {
          // Chessboard is from bottom left but screen draws from top left
-         C2D_DrawRectSolid(float(40 + possibleMoves[gameState.selectedPiece.column][gameState.selectedPiece.row][i].column * 30), float(210 - 30 * possibleMoves[gameState.selectedPiece.column][gameState.selectedPiece.row][i].row), 0.0f, 30.0f, 30.0f, drawObject.clrGreen);
+         Position target = positionOf(moveTo(possibleMoves.moves[i]));
+         C2D_DrawRectSolid(float(40 + target.column * 30), float(210 - 30 * target.row), 0.0f, 30.0f, 30.0f, drawObject.clrGreen);
       }
       C2D_DrawRectSolid(float(40 + gameState.selectedPiece.column * 30), float(210 - 30 * gameState.selectedPiece.row), 0.0f, 30.0f, 30.0f, drawObject.clrDarkBlue);
    }
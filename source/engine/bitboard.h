@@ -0,0 +1,206 @@
+#pragma once
+
+#include "types.h"
+
+typedef u64 Bitboard;
+
+// Squares are numbered row * 8 + column, so a1 = 0, h1 = 7 and a8 = 56.
+#define BIT(square) ((Bitboard)1 << (square))
+
+const Bitboard COLUMN_A = 0x0101010101010101ULL;
+const Bitboard COLUMN_H = 0x8080808080808080ULL;
+const Bitboard ROW_1 = 0x00000000000000FFULL;
+const Bitboard ROW_8 = 0xFF00000000000000ULL;
+
+inline u8 popCount(Bitboard b) {
+   return __builtin_popcountll(b);
+}
+
+inline u8 lowestSquare(Bitboard b) {
+   return __builtin_ctzll(b);
+}
+
+// Returns the lowest square and removes it from the bitboard.
+inline u8 popLowestSquare(Bitboard &b) {
+   u8 square = __builtin_ctzll(b);
+   b &= b - 1;
+   return square;
+}
+
+struct Magic {
+   Bitboard mask;
+   Bitboard magic;
+   Bitboard* attacks;
+   u8 shift;
+};
+
+// Magic multipliers found offline. Each one maps every blocker subset of the square's mask to a unique
+// (or constructively colliding) slot in the attack table.
+const Bitboard ROOK_MAGICS[64] = {
+   0x1080004008801020ULL, 0x0840092002C03000ULL, 0x1900200010400900ULL, 0x0880100008000480ULL,
+   0x4200100420080200ULL, 0x8100020100080400ULL, 0x0200040110886200ULL, 0x0200008040220411ULL,
+   0x0404800084400220ULL, 0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+   0x000A001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL, 0x0442000102105084ULL,
+   0x9080010020804100ULL, 0x0040404000201009ULL, 0x0000808010002009ULL, 0x2200090021D00100ULL,
+   0x0008008008040080ULL, 0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000A0001768104ULL,
+   0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL,
+   0x0442000A00049020ULL, 0x2100040080020080ULL, 0x0800120400900148ULL, 0x0010040A00128541ULL,
+   0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+   0x0400802402800800ULL, 0xC100020080800400ULL, 0x0002000802000401ULL, 0x0182085882000401ULL,
+   0x0220204000808000ULL, 0x2860100040024022ULL, 0x0001002004110040ULL, 0x99101042000A0020ULL,
+   0x0004080004008080ULL, 0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+   0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040A00300ULL, 0x0801100280080480ULL,
+   0x0242009008200600ULL, 0x1002000489500200ULL, 0x0040800200010080ULL, 0x0091800041000080ULL,
+   0x0000209300488001ULL, 0x04C1002414824001ULL, 0x020020000B001041ULL, 0x7000100004200901ULL,
+   0x8002002004100802ULL, 0x30010002084C0007ULL, 0x0888221800813004ULL, 0x4000002840840112ULL
+};
+
+const Bitboard BISHOP_MAGICS[64] = {
+   0xA010041108003100ULL, 0x006082020A002900ULL, 0x6810010619200000ULL, 0x08281A0520000408ULL,
+   0x0001104001000400ULL, 0x0018901008048400ULL, 0x00040A0210245280ULL, 0x000200210808A402ULL,
+   0x9140048410821200ULL, 0x0800091010820041ULL, 0x20504804832202C0ULL, 0x0100091401081000ULL,
+   0x8021011140000012ULL, 0x0810020804450400ULL, 0x208B0542109008A2ULL, 0x0080084A08040204ULL,
+   0x0040E2A80811244CULL, 0x2505022008008108ULL, 0x0430220100420040ULL, 0x010A040420220040ULL,
+   0x1105000290400000ULL, 0x0093001200822120ULL, 0x4000A62048043004ULL, 0x280120048A015004ULL,
+   0x006090002A020814ULL, 0x44042000240800D0ULL, 0x01102800040A4400ULL, 0x1004080080220040ULL,
+   0x0001001011004024ULL, 0x0010044000805040ULL, 0x0914041200820100ULL, 0x0004821012821480ULL,
+   0x0024040500C05021ULL, 0x0088611002080200ULL, 0x0116080A00040020ULL, 0x4000020080080080ULL,
+   0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL, 0x8081110600002E00ULL,
+   0x2842101105000801ULL, 0x1100809008001025ULL, 0x00020202221C0400ULL, 0x0422014022009020ULL,
+   0x0210046102100C00ULL, 0xC004008082029102ULL, 0x00AA461801101200ULL, 0x0404080080201108ULL,
+   0x020542108C205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL, 0x0400200042021100ULL,
+   0x00004204850400C0ULL, 0x0200100410A42102ULL, 0x1040020801210102ULL, 0x0805040410420000ULL,
+   0x2884804130100200ULL, 0x800C262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+   0x0104000012A02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL, 0x0402020801010201ULL
+};
+
+Bitboard knightAttacks[64];
+Bitboard kingAttacks[64];
+// [color][square], white = 0 and black = 1
+Bitboard pawnAttacks[2][64];
+
+// [from][to], squares strictly between two squares on a shared row, column or diagonal
+Bitboard betweenSquares[64][64];
+// [from][to], the whole line through two squares on a shared row, column or diagonal
+Bitboard lineThrough[64][64];
+
+Magic rookMagics[64];
+Magic bishopMagics[64];
+Bitboard rookTable[102400];
+Bitboard bishopTable[5248];
+
+inline Bitboard rookAttacks(u8 square, Bitboard occupied) {
+   const Magic & m = rookMagics[square];
+   return m.attacks[((occupied & m.mask) * m.magic) >> m.shift];
+}
+
+inline Bitboard bishopAttacks(u8 square, Bitboard occupied) {
+   const Magic & m = bishopMagics[square];
+   return m.attacks[((occupied & m.mask) * m.magic) >> m.shift];
+}
+
+inline Bitboard queenAttacks(u8 square, Bitboard occupied) {
+   return rookAttacks(square, occupied) | bishopAttacks(square, occupied);
+}
+
+// Walks each direction until the edge or a blocker. Only used to fill the tables.
+static Bitboard slidingAttacks(u8 square, Bitboard occupied, const s8 (&directions)[4][2]) {
+   Bitboard attacks = 0;
+   for (u8 d = 0; d < 4; d++) {
+      s8 column = square % 8 + directions[d][0];
+      s8 row = square / 8 + directions[d][1];
+      while (column >= 0 && column < 8 && row >= 0 && row < 8) {
+         attacks |= BIT(row * 8 + column);
+         if (occupied & BIT(row * 8 + column)) {
+            break;
+         }
+         column += directions[d][0];
+         row += directions[d][1];
+      }
+   }
+   return attacks;
+}
+
+static Bitboard* initMagics(Magic (&magics)[64], const Bitboard (&multipliers)[64], Bitboard* table, const s8 (&directions)[4][2]) {
+   for (u8 square = 0; square < 64; square++) {
+      // Edge squares never block anything further, so they are left out of the mask.
+      Bitboard edges = ((ROW_1 | ROW_8) & ~(ROW_1 << (square / 8 * 8))) | ((COLUMN_A | COLUMN_H) & ~(COLUMN_A << (square % 8)));
+      Magic & m = magics[square];
+      m.mask = slidingAttacks(square, 0, directions) & ~edges;
+      m.magic = multipliers[square];
+      m.shift = 64 - popCount(m.mask);
+      m.attacks = table;
+
+      // Enumerate every subset of the mask (Carry-Rippler).
+      Bitboard subset = 0;
+      do {
+         m.attacks[(subset * m.magic) >> m.shift] = slidingAttacks(square, subset, directions);
+         subset = (subset - m.mask) & m.mask;
+      } while (subset);
+
+      table += (Bitboard)1 << popCount(m.mask);
+   }
+   return table;
+}
+
+void initBitboards() {
+   const s8 KNIGHT_STEPS[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+   const s8 ROOK_DIRECTIONS[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+   const s8 BISHOP_DIRECTIONS[4][2] = { {1, 1}, {-1, 1}, {1, -1}, {-1, -1} };
+
+   for (u8 square = 0; square < 64; square++) {
+      s8 column = square % 8;
+      s8 row = square / 8;
+
+      knightAttacks[square] = 0;
+      for (u8 i = 0; i < 8; i++) {
+         s8 c = column + KNIGHT_STEPS[i][0];
+         s8 r = row + KNIGHT_STEPS[i][1];
+         if (c >= 0 && c < 8 && r >= 0 && r < 8) {
+            knightAttacks[square] |= BIT(r * 8 + c);
+         }
+      }
+
+      kingAttacks[square] = 0;
+      for (s8 c = column - 1; c <= column + 1; c++) {
+         for (s8 r = row - 1; r <= row + 1; r++) {
+            if (c >= 0 && c < 8 && r >= 0 && r < 8 && !(c == column && r == row)) {
+               kingAttacks[square] |= BIT(r * 8 + c);
+            }
+         }
+      }
+
+      // Squares a pawn on this square attacks. White captures up, black captures down.
+      pawnAttacks[0][square] = 0;
+      pawnAttacks[1][square] = 0;
+      if (row < 7) {
+         if (column > 0) { pawnAttacks[0][square] |= BIT(square + 7); }
+         if (column < 7) { pawnAttacks[0][square] |= BIT(square + 9); }
+      }
+      if (row > 0) {
+         if (column > 0) { pawnAttacks[1][square] |= BIT(square - 9); }
+         if (column < 7) { pawnAttacks[1][square] |= BIT(square - 7); }
+      }
+   }
+
+   initMagics(rookMagics, ROOK_MAGICS, rookTable, ROOK_DIRECTIONS);
+   initMagics(bishopMagics, BISHOP_MAGICS, bishopTable, BISHOP_DIRECTIONS);
+
+   for (u8 a = 0; a < 64; a++) {
+      for (u8 b = 0; b < 64; b++) {
+         betweenSquares[a][b] = 0;
+         lineThrough[a][b] = 0;
+         if (a == b) {
+            continue;
+         }
+         if (rookAttacks(a, 0) & BIT(b)) {
+            betweenSquares[a][b] = rookAttacks(a, BIT(b)) & rookAttacks(b, BIT(a));
+            lineThrough[a][b] = (rookAttacks(a, 0) & rookAttacks(b, 0)) | BIT(a) | BIT(b);
+         }
+         else if (bishopAttacks(a, 0) & BIT(b)) {
+            betweenSquares[a][b] = bishopAttacks(a, BIT(b)) & bishopAttacks(b, BIT(a));
+            lineThrough[a][b] = (bishopAttacks(a, 0) & bishopAttacks(b, 0)) | BIT(a) | BIT(b);
+         }
+      }
+   }
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include "bitboard.h"
+#include "zobrist.h"
+
+struct Position {
+   s8 column;
+   s8 row;
+};
+
+enum Piece : u8 { none, king, queen, rook, knight, bishop, pawn };
+enum Color : u8 { white, black };
+
+// A move packed into 16 bits:
+// bits 0-5 start square, bits 6-11 end square, bits 12-13 promotion piece, bits 14-15 flag.
+typedef u16 Move;
+
+enum MoveFlag { MOVE_NORMAL = 0, MOVE_PROMOTION = 1, MOVE_EN_PASSANT = 2, MOVE_CASTLING = 3 };
+
+// No legal move starts and ends on the same square.
+const Move MOVE_NONE = 0;
+
+inline Move createMove(u8 from, u8 to, MoveFlag flag = MOVE_NORMAL, Piece promotion = queen) {
+   return from | (to << 6) | ((promotion - queen) << 12) | (flag << 14);
+}
+
+inline u8 moveFrom(Move move) {
+   return move & 0x3F;
+}
+
+inline u8 moveTo(Move move) {
+   return (move >> 6) & 0x3F;
+}
+
+inline MoveFlag moveFlag(Move move) {
+   return (MoveFlag)(move >> 14);
+}
+
+// The piece a pawn turns into, or none if the move isn't a promotion.
+inline Piece movePromotion(Move move) {
+   return (moveFlag(move) == MOVE_PROMOTION) ? (Piece)(queen + ((move >> 12) & 3)) : none;
+}
+
+enum CastlingRights { CASTLE_WHITE_LEFT = 1, CASTLE_WHITE_RIGHT = 2, CASTLE_BLACK_LEFT = 4, CASTLE_BLACK_RIGHT = 8 };
+
+// Castling rights that survive a move touching the square. Moving from or capturing on a king or rook start square clears them.
+const u8 CASTLING_KEPT[64] = {
+   14, 15, 15, 15, 12, 15, 15, 13,
+   15, 15, 15, 15, 15, 15, 15, 15,
+   15, 15, 15, 15, 15, 15, 15, 15,
+   15, 15, 15, 15, 15, 15, 15, 15,
+   15, 15, 15, 15, 15, 15, 15, 15,
+   15, 15, 15, 15, 15, 15, 15, 15,
+   15, 15, 15, 15, 15, 15, 15, 15,
+   11, 15, 15, 15,  3, 15, 15,  7
+};
+
+struct Board {
+   // [color][piece], none is unused
+   Bitboard pieces[2][7];
+   Bitboard colors[2];
+   Bitboard occupied;
+   // Zobrist key of everything below that matters for repetition: pieces, castling, en passant and turn
+   u64 key;
+   // [square], piece | (color << 3), 0 if empty
+   u8 squares[64];
+   u8 castling;
+   // Square a pawn can move onto to capture en passant, or -1. Only set if an enemy pawn is next to the pawn
+   // that moved, so positions that only differ in an unusable en passant square get the same key.
+   s8 enPassant;
+   // Side to move
+   Color turn;
+   // Plies since the last capture or pawn move, stops at 255
+   u8 halfmoveClock;
+};
+
+inline u8 squareOf(Position position) {
+   return position.row * 8 + position.column;
+}
+
+inline Position positionOf(u8 square) {
+   Position position;
+   position.column = square % 8;
+   position.row = square / 8;
+   return position;
+}
+
+inline Piece pieceOn(const Board &board, u8 square) {
+   return (Piece)(board.squares[square] & 7);
+}
+
+// Only meaningful if the square has a piece on it.
+inline Color colorOn(const Board &board, u8 square) {
+   return (Color)(board.squares[square] >> 3);
+}
+
+inline void putPiece(Board &board, Color color, Piece piece, u8 square) {
+   board.pieces[color][piece] |= BIT(square);
+   board.colors[color] |= BIT(square);
+   board.occupied |= BIT(square);
+   board.squares[square] = piece | (color << 3);
+   board.key ^= zobristPieces[color][piece][square];
+}
+
+inline void removePiece(Board &board, Color color, Piece piece, u8 square) {
+   board.pieces[color][piece] &= ~BIT(square);
+   board.colors[color] &= ~BIT(square);
+   board.occupied &= ~BIT(square);
+   board.squares[square] = 0;
+   board.key ^= zobristPieces[color][piece][square];
+}
+
+// Builds the key from scratch. makeMove() keeps it up to date after that.
+u64 computeKey(const Board &board) {
+   u64 key = zobristCastling[board.castling];
+   for (u8 square = 0; square < 64; square++) {
+      if (board.squares[square]) {
+         key ^= zobristPieces[colorOn(board, square)][pieceOn(board, square)][square];
+      }
+   }
+   if (board.enPassant >= 0) {
+      key ^= zobristEnPassant[board.enPassant % 8];
+   }
+   if (board.turn == black) {
+      key ^= zobristBlackToMove;
+   }
+   return key;
+}
+
+inline u8 kingSquare(const Board &board, Color color) {
+   return lowestSquare(board.pieces[color][king]);
+}
+
+// Returns if any piece of the attacking color could capture on the square.
+bool squareAttacked(const Board &board, u8 square, Color attacker) {
+   const Bitboard (&pieces)[7] = board.pieces[attacker];
+   return (pawnAttacks[!attacker][square] & pieces[pawn])
+      || (knightAttacks[square] & pieces[knight])
+      || (kingAttacks[square] & pieces[king])
+      || (bishopAttacks(square, board.occupied) & (pieces[bishop] | pieces[queen]))
+      || (rookAttacks(square, board.occupied) & (pieces[rook] | pieces[queen]));
+}
+
+// What makeMove() overwrites that can't be worked out again from the move itself. Castling rights
+// stand in for the king and rook moved flags, and the king square is read from the bitboards.
+struct Undo {
+   u64 key;
+   Piece captured;
+   u8 castling;
+   s8 enPassant;
+   u8 halfmoveClock;
+};
+
+// Moves a piece, including the rook in castling and the pawn taken en passant.
+void makeMove(Board &board, Move move, Undo &undo) {
+   u8 from = moveFrom(move);
+   u8 to = moveTo(move);
+   Color color = colorOn(board, from);
+   Piece piece = pieceOn(board, from);
+   Piece captured = pieceOn(board, to);
+
+   undo.key = board.key;
+   undo.captured = captured;
+   undo.castling = board.castling;
+   undo.enPassant = board.enPassant;
+   undo.halfmoveClock = board.halfmoveClock;
+
+   if (captured) {
+      removePiece(board, (Color)!color, captured, to);
+   }
+   removePiece(board, color, piece, from);
+   putPiece(board, color, (moveFlag(move) == MOVE_PROMOTION) ? movePromotion(move) : piece, to);
+
+   if (moveFlag(move) == MOVE_EN_PASSANT) {
+      // The captured pawn sits behind the square moved onto.
+      removePiece(board, (Color)!color, pawn, (color == white) ? to - 8 : to + 8);
+      undo.captured = pawn;
+   }
+   else if (moveFlag(move) == MOVE_CASTLING) {
+      // The rook jumps over the king from its corner.
+      u8 rookFrom = (to > from) ? from + 3 : from - 4;
+      u8 rookTo = (to > from) ? from + 1 : from - 1;
+      removePiece(board, color, rook, rookFrom);
+      putPiece(board, color, rook, rookTo);
+   }
+
+   // Moving a king or rook, or capturing a rook in its corner, loses the matching castling rights.
+   board.key ^= zobristCastling[board.castling];
+   board.castling &= CASTLING_KEPT[from] & CASTLING_KEPT[to];
+   board.key ^= zobristCastling[board.castling];
+
+   if (board.enPassant >= 0) {
+      board.key ^= zobristEnPassant[board.enPassant % 8];
+      board.enPassant = -1;
+   }
+   if (piece == pawn && (to - from == 16 || from - to == 16)
+      && (pawnAttacks[color][(from + to) / 2] & board.pieces[!color][pawn])) {
+      board.enPassant = (from + to) / 2;
+      board.key ^= zobristEnPassant[board.enPassant % 8];
+   }
+
+   if (piece == pawn || captured || moveFlag(move) == MOVE_EN_PASSANT) {
+      board.halfmoveClock = 0;
+   }
+   else if (board.halfmoveClock < 255) {
+      board.halfmoveClock++;
+   }
+
+   board.turn = (Color)!color;
+   board.key ^= zobristBlackToMove;
+}
+
+// Reverses makeMove() with the same move and the undo record it filled in.
+void unmakeMove(Board &board, Move move, const Undo &undo) {
+   u8 from = moveFrom(move);
+   u8 to = moveTo(move);
+   Color color = colorOn(board, to);
+   Piece piece = (moveFlag(move) == MOVE_PROMOTION) ? pawn : pieceOn(board, to);
+
+   removePiece(board, color, pieceOn(board, to), to);
+   putPiece(board, color, piece, from);
+
+   if (moveFlag(move) == MOVE_EN_PASSANT) {
+      putPiece(board, (Color)!color, pawn, (color == white) ? to - 8 : to + 8);
+   }
+   else if (moveFlag(move) == MOVE_CASTLING) {
+      u8 rookFrom = (to > from) ? from + 3 : from - 4;
+      u8 rookTo = (to > from) ? from + 1 : from - 1;
+      removePiece(board, color, rook, rookTo);
+      putPiece(board, color, rook, rookFrom);
+   }
+   else if (undo.captured) {
+      putPiece(board, (Color)!color, undo.captured, to);
+   }
+
+   board.castling = undo.castling;
+   board.enPassant = undo.enPassant;
+   board.halfmoveClock = undo.halfmoveClock;
+   board.turn = color;
+   board.key = undo.key;
+}
+
+// Adds the flags a move needs from the position it's played in. Used for moves that arrive as plain squares.
+Move inferMove(const Board &board, u8 from, u8 to, Piece promotion) {
+   if (promotion) {
+      return createMove(from, to, MOVE_PROMOTION, promotion);
+   }
+   if (pieceOn(board, from) == king && (to - from == 2 || from - to == 2)) {
+      return createMove(from, to, MOVE_CASTLING);
+   }
+   if (pieceOn(board, from) == pawn && to == board.enPassant) {
+      return createMove(from, to, MOVE_EN_PASSANT);
+   }
+   return createMove(from, to);
+}
+
+void setupStartPosition(Board &board) {
+   const Piece LAYOUT[] = { rook, knight, bishop, queen, king, bishop, knight, rook };
+   memset(&board, 0, sizeof(board));
+   // First and last rows
+   for (u8 i = 0; i < 8; i++) {
+      putPiece(board, white, LAYOUT[i], i);
+      putPiece(board, black, LAYOUT[i], 56 + i);
+   }
+   // Pawns
+   for (u8 i = 0; i < 8; i++) {
+      putPiece(board, white, pawn, 8 + i);
+      putPiece(board, black, pawn, 48 + i);
+   }
+   board.castling = CASTLE_WHITE_LEFT | CASTLE_WHITE_RIGHT | CASTLE_BLACK_LEFT | CASTLE_BLACK_RIGHT;
+   board.enPassant = -1;
+   board.turn = white;
+   board.key = computeKey(board);
+}
+
+// One more than the largest halfmoveClock, so the history reaches back as far as repetitions() looks.
+#define MAX_HISTORY 256
+
+// Keys of the positions a game has been through, the current one last. Only the last MAX_HISTORY are kept.
+struct PositionHistory {
+   u64 keys[MAX_HISTORY];
+   u16 size;
+};
+
+inline void clearHistory(PositionHistory &history) {
+   history.size = 0;
+}
+
+inline void pushPosition(PositionHistory &history, u64 key) {
+   history.keys[history.size++ % MAX_HISTORY] = key;
+}
+
+// Counts how often the current position (the last one pushed) occurred before. Only positions since the last
+// capture or pawn move with the same side to move can match, so it steps back two plies at a time.
+u8 repetitions(const PositionHistory &history, const Board &board) {
+   if (!history.size) {
+      return 0;
+   }
+   u16 back = board.halfmoveClock;
+   if (back > history.size - 1) {
+      back = history.size - 1;
+   }
+   u8 count = 0;
+   for (u16 i = 2; i <= back; i += 2) {
+      if (history.keys[(history.size - 1 - i) % MAX_HISTORY] == board.key) {
+         count++;
+      }
+   }
+   return count;
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "movegen.h"
+
+#ifndef _3DS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Opening book file: a header of "C3BK", the record count and the key of the start position, then the records
+// sorted by key and then move. Everything is little endian. The start position's key changes whenever the
+// Zobrist numbers do, which would make every key in the book wrong, so books built with other numbers are
+// refused.
+#define BOOK_MAGIC 0x4B423343
+#define BOOK_HEADER_SIZE 16
+#define BOOK_RECORD_SIZE 12
+
+// Most book moves looked at in one position
+#define MAX_BOOK_MOVES 32
+
+struct BookRecord {
+   u64 key;
+   Move move;
+   // How likely the move is to be picked, relative to the position's other moves
+   u16 weight;
+};
+
+// Searched in place with no per-probe allocation: the host maps the file into memory, the 3DS reads the records
+// it needs from romfs.
+struct OpeningBook {
+#ifdef _3DS
+   FILE* file;
+#else
+   const u8* data;
+   size_t size;
+#endif
+   u32 count;
+};
+
+inline u64 readLittleEndian(const u8* bytes, u8 size) {
+   u64 value = 0;
+   for (u8 i = size; i-- > 0;) {
+      value = (value << 8) | bytes[i];
+   }
+   return value;
+}
+
+inline void writeLittleEndian(u8* bytes, u64 value, u8 size) {
+   for (u8 i = 0; i < size; i++) {
+      bytes[i] = value >> (8 * i);
+   }
+}
+
+inline void encodeBookRecord(const BookRecord &record, u8 (&bytes)[BOOK_RECORD_SIZE]) {
+   writeLittleEndian(bytes, record.key, 8);
+   writeLittleEndian(bytes + 8, record.move, 2);
+   writeLittleEndian(bytes + 10, record.weight, 2);
+}
+
+inline void decodeBookRecord(const u8* bytes, BookRecord &record) {
+   record.key = readLittleEndian(bytes, 8);
+   record.move = readLittleEndian(bytes + 8, 2);
+   record.weight = readLittleEndian(bytes + 10, 2);
+}
+
+inline void encodeBookHeader(u32 count, u8 (&bytes)[BOOK_HEADER_SIZE]) {
+   Board start;
+   setupStartPosition(start);
+   writeLittleEndian(bytes, BOOK_MAGIC, 4);
+   writeLittleEndian(bytes + 4, count, 4);
+   writeLittleEndian(bytes + 8, start.key, 8);
+}
+
+// Checks the header and returns the record count, or -1 if it isn't a book or not one for these keys.
+s64 decodeBookHeader(const u8* bytes, u64 fileSize) {
+   Board start;
+   setupStartPosition(start);
+   if (fileSize < BOOK_HEADER_SIZE || readLittleEndian(bytes, 4) != BOOK_MAGIC || readLittleEndian(bytes + 8, 8) != start.key) {
+      return -1;
+   }
+   u32 count = readLittleEndian(bytes + 4, 4);
+   if (BOOK_HEADER_SIZE + (u64)count * BOOK_RECORD_SIZE > fileSize) {
+      return -1;
+   }
+   return count;
+}
+
+// Returns false if the file is missing or isn't a usable book, in which case the book is empty.
+bool openBook(OpeningBook &book, const char* path) {
+   book.count = 0;
+#ifdef _3DS
+   book.file = fopen(path, "rb");
+   if (!book.file) {
+      return false;
+   }
+   u8 header[BOOK_HEADER_SIZE];
+   fseek(book.file, 0, SEEK_END);
+   long size = ftell(book.file);
+   fseek(book.file, 0, SEEK_SET);
+   s64 count = (size > 0 && fread(header, BOOK_HEADER_SIZE, 1, book.file) == 1) ? decodeBookHeader(header, size) : -1;
+   if (count < 0) {
+      fclose(book.file);
+      book.file = NULL;
+      return false;
+   }
+#else
+   book.data = NULL;
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      return false;
+   }
+   struct stat status;
+   void* data = (fstat(fd, &status) == 0 && status.st_size > 0) ? mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+   // The mapping stays valid without the descriptor.
+   close(fd);
+   if (data == MAP_FAILED) {
+      return false;
+   }
+   s64 count = decodeBookHeader((const u8*)data, status.st_size);
+   if (count < 0) {
+      munmap(data, status.st_size);
+      return false;
+   }
+   book.data = (const u8*)data;
+   book.size = status.st_size;
+#endif
+   book.count = count;
+   return true;
+}
+
+void closeBook(OpeningBook &book) {
+#ifdef _3DS
+   if (book.file) {
+      fclose(book.file);
+      book.file = NULL;
+   }
+#else
+   if (book.data) {
+      munmap((void*)book.data, book.size);
+      book.data = NULL;
+   }
+#endif
+   book.count = 0;
+}
+
+bool readBookRecord(const OpeningBook &book, u32 index, BookRecord &record) {
+#ifdef _3DS
+   u8 bytes[BOOK_RECORD_SIZE];
+   if (fseek(book.file, BOOK_HEADER_SIZE + (long)index * BOOK_RECORD_SIZE, SEEK_SET) != 0
+      || fread(bytes, BOOK_RECORD_SIZE, 1, book.file) != 1) {
+      return false;
+   }
+   decodeBookRecord(bytes, record);
+#else
+   decodeBookRecord(book.data + BOOK_HEADER_SIZE + (size_t)index * BOOK_RECORD_SIZE, record);
+#endif
+   return true;
+}
+
+// Binary search for the position's records. Returns how many there are, at most MAX_BOOK_MOVES.
+u8 findBookRecords(const OpeningBook &book, u64 key, BookRecord (&records)[MAX_BOOK_MOVES]) {
+   u32 low = 0;
+   u32 high = book.count;
+   BookRecord record;
+   while (low < high) {
+      u32 middle = low + (high - low) / 2;
+      if (!readBookRecord(book, middle, record)) {
+         return 0;
+      }
+      if (record.key < key) {
+         low = middle + 1;
+      }
+      else {
+         high = middle;
+      }
+   }
+
+   u8 found = 0;
+   for (u32 i = low; i < book.count && found < MAX_BOOK_MOVES; i++) {
+      if (!readBookRecord(book, i, record) || record.key != key) {
+         break;
+      }
+      records[found++] = record;
+   }
+   return found;
+}
+
+// Picks one of the position's book moves with a chance proportional to its weight, given a random number.
+// Moves that aren't legal, which a key collision could bring up, are passed over. Returns MOVE_NONE when the
+// position isn't in the book.
+Move pickBookMove(const OpeningBook &book, Board &board, u32 random) {
+   BookRecord records[MAX_BOOK_MOVES];
+   u8 found = findBookRecords(book, board.key, records);
+   if (!found) {
+      return MOVE_NONE;
+   }
+
+   MoveList moves;
+   calculateLegalMoves(board, moves);
+   u32 total = 0;
+   for (u8 i = 0; i < found; i++) {
+      bool legal = false;
+      u8 from = moveFrom(records[i].move);
+      for (u16 m = moves.first[from]; m < moves.first[from] + moves.count[from]; m++) {
+         legal |= moves.moves[m] == records[i].move;
+      }
+      if (!legal) {
+         records[i].weight = 0;
+      }
+      total += records[i].weight;
+   }
+   if (!total) {
+      return MOVE_NONE;
+   }
+
+   u32 pick = random % total;
+   for (u8 i = 0; i < found; i++) {
+      if (pick < records[i].weight) {
+         return records[i].move;
+      }
+      pick -= records[i].weight;
+   }
+   return MOVE_NONE;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "board.h"
+
+// Centipawns, [piece]
+const s16 PIECE_VALUES[7] = { 0, 0, 900, 500, 320, 330, 100 };
+
+// Bonus for standing on a square, written from white's side with the 8th row first. Tomasz Michniewski's
+// simplified evaluation tables.
+const s8 PAWN_SQUARES[64] = {
+    0,   0,   0,   0,   0,   0,   0,   0,
+   50,  50,  50,  50,  50,  50,  50,  50,
+   10,  10,  20,  30,  30,  20,  10,  10,
+    5,   5,  10,  25,  25,  10,   5,   5,
+    0,   0,   0,  20,  20,   0,   0,   0,
+    5,  -5, -10,   0,   0, -10,  -5,   5,
+    5,  10,  10, -20, -20,  10,  10,   5,
+    0,   0,   0,   0,   0,   0,   0,   0
+};
+
+const s8 KNIGHT_SQUARES[64] = {
+  -50, -40, -30, -30, -30, -30, -40, -50,
+  -40, -20,   0,   0,   0,   0, -20, -40,
+  -30,   0,  10,  15,  15,  10,   0, -30,
+  -30,   5,  15,  20,  20,  15,   5, -30,
+  -30,   0,  15,  20,  20,  15,   0, -30,
+  -30,   5,  10,  15,  15,  10,   5, -30,
+  -40, -20,   0,   5,   5,   0, -20, -40,
+  -50, -40, -30, -30, -30, -30, -40, -50
+};
+
+const s8 BISHOP_SQUARES[64] = {
+  -20, -10, -10, -10, -10, -10, -10, -20,
+  -10,   0,   0,   0,   0,   0,   0, -10,
+  -10,   0,   5,  10,  10,   5,   0, -10,
+  -10,   5,   5,  10,  10,   5,   5, -10,
+  -10,   0,  10,  10,  10,  10,   0, -10,
+  -10,  10,  10,  10,  10,  10,  10, -10,
+  -10,   5,   0,   0,   0,   0,   5, -10,
+  -20, -10, -10, -10, -10, -10, -10, -20
+};
+
+const s8 ROOK_SQUARES[64] = {
+    0,   0,   0,   0,   0,   0,   0,   0,
+    5,  10,  10,  10,  10,  10,  10,   5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+    0,   0,   0,   5,   5,   0,   0,   0
+};
+
+const s8 QUEEN_SQUARES[64] = {
+  -20, -10, -10,  -5,  -5, -10, -10, -20,
+  -10,   0,   0,   0,   0,   0,   0, -10,
+  -10,   0,   5,   5,   5,   5,   0, -10,
+   -5,   0,   5,   5,   5,   5,   0,  -5,
+    0,   0,   5,   5,   5,   5,   0,  -5,
+  -10,   5,   5,   5,   5,   5,   0, -10,
+  -10,   0,   5,   0,   0,   0,   0, -10,
+  -20, -10, -10,  -5,  -5, -10, -10, -20
+};
+
+// While queens are on the board the king hides behind its pawns...
+const s8 KING_SQUARES[64] = {
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -20, -30, -30, -40, -40, -30, -30, -20,
+  -10, -20, -20, -20, -20, -20, -20, -10,
+   20,  20,   0,   0,   0,   0,  20,  20,
+   20,  30,  10,   0,   0,  10,  30,  20
+};
+
+// ...and once they're gone it heads for the center.
+const s8 KING_ENDGAME_SQUARES[64] = {
+  -50, -40, -30, -20, -20, -30, -40, -50,
+  -30, -20, -10,   0,   0, -10, -20, -30,
+  -30, -10,  20,  30,  30,  20, -10, -30,
+  -30, -10,  30,  40,  40,  30, -10, -30,
+  -30, -10,  30,  40,  40,  30, -10, -30,
+  -30, -10,  20,  30,  30,  20, -10, -30,
+  -30, -30,   0,   0,   0,   0, -30, -30,
+  -50, -30, -30, -30, -30, -30, -30, -50
+};
+
+// [piece], with the king's table for while queens are on
+const s8* const PIECE_SQUARES[7] = { NULL, KING_SQUARES, QUEEN_SQUARES, ROOK_SQUARES, KNIGHT_SQUARES, BISHOP_SQUARES, PAWN_SQUARES };
+
+// Material and piece placement, in centipawns from the side to move's point of view.
+s16 evaluate(const Board &board) {
+   bool endgame = !(board.pieces[white][queen] | board.pieces[black][queen]);
+   s16 score = 0;
+   for (u8 color = white; color <= black; color++) {
+      s16 side = 0;
+      // The tables are written from white's side, so white's squares are mirrored vertically.
+      u8 flip = (color == white) ? 56 : 0;
+      for (u8 piece = king; piece <= pawn; piece++) {
+         const s8* squares = (piece == king && endgame) ? KING_ENDGAME_SQUARES : PIECE_SQUARES[piece];
+         Bitboard pieces = board.pieces[color][piece];
+         while (pieces) {
+            side += PIECE_VALUES[piece] + squares[popLowestSquare(pieces) ^ flip];
+         }
+      }
+      score += (color == board.turn) ? side : -side;
+   }
+   return score;
+}
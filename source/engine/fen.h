@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "movegen.h"
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+// Longest FEN writeFen() can write, with its terminator
+#define FEN_SIZE 92
+
+// Sets up the board from a FEN string. Returns false if the piece placement or side to move can't be read, or
+// the position can't come up in a game: pawns on the first or last row, or the side that just moved in check.
+// Castling rights whose king or rook isn't on its start square are dropped. The fullmove number is accepted
+// but not stored.
+bool loadFen(Board &board, const char* fen) {
+   const char PIECE_LETTERS[] = " kqrnbp";
+   memset(&board, 0, sizeof(board));
+   board.enPassant = -1;
+
+   // Piece placement, from the 8th row down
+   s8 column = 0;
+   s8 row = 7;
+   for (; *fen && *fen != ' '; fen++) {
+      if (*fen == '/') {
+         column = 0;
+         row--;
+      }
+      else if (*fen >= '1' && *fen <= '8') {
+         column += *fen - '0';
+      }
+      else {
+         const char* letter = strchr(PIECE_LETTERS + 1, *fen | 0x20);
+         if (!letter || column > 7 || row < 0) {
+            return false;
+         }
+         putPiece(board, (*fen & 0x20) ? black : white, (Piece)(letter - PIECE_LETTERS), row * 8 + column);
+         column++;
+      }
+   }
+   if (popCount(board.pieces[white][king]) != 1 || popCount(board.pieces[black][king]) != 1) {
+      return false;
+   }
+   if ((board.pieces[white][pawn] | board.pieces[black][pawn]) & (ROW_1 | ROW_8)) {
+      return false;
+   }
+
+   // Side to move
+   while (*fen == ' ') { fen++; }
+   if (*fen != 'w' && *fen != 'b') {
+      return false;
+   }
+   board.turn = (*fen == 'w') ? white : black;
+   fen++;
+   if (squareAttacked(board, kingSquare(board, (Color)!board.turn), board.turn)) {
+      return false;
+   }
+
+   // Castling rights
+   while (*fen == ' ') { fen++; }
+   for (; *fen && *fen != ' '; fen++) {
+      switch (*fen) {
+      case 'K': board.castling |= CASTLE_WHITE_RIGHT; break;
+      case 'Q': board.castling |= CASTLE_WHITE_LEFT; break;
+      case 'k': board.castling |= CASTLE_BLACK_RIGHT; break;
+      case 'q': board.castling |= CASTLE_BLACK_LEFT; break;
+      }
+   }
+   // Move generation takes the king and rook to be where castling starts from.
+   if (!(board.pieces[white][king] & BIT(4))) {
+      board.castling &= ~(CASTLE_WHITE_LEFT | CASTLE_WHITE_RIGHT);
+   }
+   if (!(board.pieces[black][king] & BIT(60))) {
+      board.castling &= ~(CASTLE_BLACK_LEFT | CASTLE_BLACK_RIGHT);
+   }
+   if (!(board.pieces[white][rook] & BIT(0))) {
+      board.castling &= ~CASTLE_WHITE_LEFT;
+   }
+   if (!(board.pieces[white][rook] & BIT(7))) {
+      board.castling &= ~CASTLE_WHITE_RIGHT;
+   }
+   if (!(board.pieces[black][rook] & BIT(56))) {
+      board.castling &= ~CASTLE_BLACK_LEFT;
+   }
+   if (!(board.pieces[black][rook] & BIT(63))) {
+      board.castling &= ~CASTLE_BLACK_RIGHT;
+   }
+
+   // En passant square
+   while (*fen == ' ') { fen++; }
+   if (fen[0] >= 'a' && fen[0] <= 'h' && fen[1] >= '1' && fen[1] <= '8') {
+      board.enPassant = (fen[1] - '1') * 8 + (fen[0] - 'a');
+      // Dropped when no pawn can take, the same as makeMove() does.
+      if (!(pawnAttacks[!board.turn][board.enPassant] & board.pieces[board.turn][pawn])) {
+         board.enPassant = -1;
+      }
+   }
+
+   // Halfmove clock
+   while (*fen && *fen != ' ') { fen++; }
+   while (*fen == ' ') { fen++; }
+   int halfmoves = atoi(fen);
+   board.halfmoveClock = (halfmoves > 255) ? 255 : (halfmoves < 0) ? 0 : halfmoves;
+
+   board.key = computeKey(board);
+   return true;
+}
+
+// Writes the board as FEN and returns the string. The board doesn't keep the move number, so it's passed in.
+// The en passant square is only written when a pawn can take, the same as makeMove() keeps it.
+char* writeFen(const Board &board, u16 fullmove, char (&text)[FEN_SIZE]) {
+   const char PIECE_LETTERS[] = " kqrnbp";
+   char* out = text;
+   for (s8 row = 7; row >= 0; row--) {
+      u8 empty = 0;
+      for (u8 column = 0; column < 8; column++) {
+         u8 square = row * 8 + column;
+         Piece piece = pieceOn(board, square);
+         if (!piece) {
+            empty++;
+            continue;
+         }
+         if (empty) {
+            *out++ = '0' + empty;
+            empty = 0;
+         }
+         *out++ = PIECE_LETTERS[piece] - ((colorOn(board, square) == white) ? 0x20 : 0);
+      }
+      if (empty) {
+         *out++ = '0' + empty;
+      }
+      if (row) {
+         *out++ = '/';
+      }
+   }
+
+   *out++ = ' ';
+   *out++ = (board.turn == white) ? 'w' : 'b';
+   *out++ = ' ';
+   if (!board.castling) {
+      *out++ = '-';
+   }
+   if (board.castling & CASTLE_WHITE_RIGHT) {
+      *out++ = 'K';
+   }
+   if (board.castling & CASTLE_WHITE_LEFT) {
+      *out++ = 'Q';
+   }
+   if (board.castling & CASTLE_BLACK_RIGHT) {
+      *out++ = 'k';
+   }
+   if (board.castling & CASTLE_BLACK_LEFT) {
+      *out++ = 'q';
+   }
+   *out++ = ' ';
+   if (board.enPassant >= 0) {
+      *out++ = 'a' + board.enPassant % 8;
+      *out++ = '1' + board.enPassant / 8;
+   }
+   else {
+      *out++ = '-';
+   }
+   snprintf(out, text + FEN_SIZE - out, " %d %d", board.halfmoveClock, fullmove);
+   return text;
+}
+
+// Writes the move in coordinate notation (e2e4, e7e8q) and returns the string.
+char* moveToString(Move move, char (&text)[6]) {
+   const char PROMOTION_LETTERS[] = "  qrnb";
+   text[0] = 'a' + moveFrom(move) % 8;
+   text[1] = '1' + moveFrom(move) / 8;
+   text[2] = 'a' + moveTo(move) % 8;
+   text[3] = '1' + moveTo(move) / 8;
+   text[4] = (movePromotion(move)) ? PROMOTION_LETTERS[movePromotion(move)] : '\0';
+   text[5] = '\0';
+   return text;
+}
+
+// Finds the legal move written in coordinate notation, or MOVE_NONE. A pawn reaching the last row without a
+// promotion letter promotes to a queen.
+Move stringToMove(const MoveList &moveList, const char* text) {
+   if (strlen(text) < 4 || text[0] < 'a' || text[0] > 'h' || text[1] < '1' || text[1] > '8'
+      || text[2] < 'a' || text[2] > 'h' || text[3] < '1' || text[3] > '8') {
+      return MOVE_NONE;
+   }
+   u8 from = (text[1] - '1') * 8 + (text[0] - 'a');
+   u8 to = (text[3] - '1') * 8 + (text[2] - 'a');
+   char promotion = (text[4] && text[4] != ' ') ? (text[4] | 0x20) : 'q';
+   char written[6];
+   for (u16 i = moveList.first[from]; i < moveList.first[from] + moveList.count[from]; i++) {
+      Move move = moveList.moves[i];
+      if (moveTo(move) == to && (!movePromotion(move) || moveToString(move, written)[4] == promotion)) {
+         return move;
+      }
+   }
+   return MOVE_NONE;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "movecache.h"
+#include "pgn.h"
+
+// Moves past this aren't saved
+#define MAX_GAME_MOVES 1024
+
+// How the game stands after the last move
+enum GameEnd : u8 { GAME_ONGOING, GAME_CHECKMATE, GAME_STALEMATE, GAME_REPETITION };
+
+// Everything the rules need for one game: the board, what's known about its moves and the moves played. The
+// functions below only touch the game they're given, so a process can keep any number of them side by side.
+// The fields used every move come first, the move storage after them.
+struct Game {
+   Board board;
+   Legality legality;
+   // Squares whose moves are in possibleMoves. The rest are only generated once they're touched.
+   Bitboard movesGenerated;
+   // Positions come back often enough (undone moves, shuffling pieces) that their moves are worth keeping.
+   // Optional and can be shared between games, NULL for none.
+   MoveCache* moveCache;
+   Move prevMove;
+   u16 turns;
+   // The side to move is in check
+   bool check;
+   GameEnd end;
+   MoveList possibleMoves;
+   PositionHistory history;
+   // The moves played from startBoard, for saving the game
+   u16 moveCount;
+   Move moves[MAX_GAME_MOVES];
+   Board startBoard;
+};
+
+// Starts the game from the position, the start position if it's NULL.
+void setupGame(Game &game, const Board* position = NULL) {
+   if (position) {
+      game.board = *position;
+   }
+   else {
+      setupStartPosition(game.board);
+   }
+   game.startBoard = game.board;
+   game.moveCount = 0;
+   game.prevMove = MOVE_NONE;
+   game.turns = 0;
+   game.check = inCheck(game.board);
+   game.end = GAME_ONGOING;
+   clearHistory(game.history);
+   pushPosition(game.history, game.board.key);
+}
+
+void calculateAllMoves(Game &game) {
+   // To be a possible move, a move needs to be within a pieces movement pattern, not blocked, and not result in an enemy piece being able to capture the king.
+   // Only what that needs is worked out here. The moves themselves come from calculateSquareMoves().
+   calculateLegality(game.board, game.board.turn, game.legality);
+   if (!game.moveCache || !probeMoveCache(*game.moveCache, game.board.key, game.possibleMoves, game.movesGenerated)) {
+      clearMoves(game.possibleMoves);
+      game.movesGenerated = 0;
+   }
+
+   // If there are no moves, it's a stalemate or checkmate. The third time the same position comes up, it's a draw.
+   switch (gameOutcome(game.board, game.legality)) {
+   case checkmate:
+      game.end = GAME_CHECKMATE;
+      break;
+   case stalemate:
+      game.end = GAME_STALEMATE;
+      break;
+   default:
+      game.end = (repetitions(game.history, game.board) >= 2) ? GAME_REPETITION : GAME_ONGOING;
+      break;
+   }
+}
+
+// Generates the legal moves of the piece on the square, the first time they're needed this turn.
+void calculateSquareMoves(Game &game, u8 square) {
+   if (!(game.movesGenerated & BIT(square)) && (game.board.colors[game.board.turn] & BIT(square))) {
+      calculateLegalPieceMoves(game.board, game.legality, square, game.possibleMoves);
+      game.movesGenerated |= BIT(square);
+   }
+}
+
+// Returns the legal move between the two squares, or MOVE_NONE. A promotion is returned as a queen promotion.
+Move validMove(Game &game, Position start, Position end) {
+   u8 square = squareOf(start);
+   u8 target = squareOf(end);
+   calculateSquareMoves(game, square);
+   const MoveList &possibleMoves = game.possibleMoves;
+   for (u16 i = possibleMoves.first[square]; i < possibleMoves.first[square] + possibleMoves.count[square]; i++) {
+      if (moveTo(possibleMoves.moves[i]) == target) {
+         return possibleMoves.moves[i];
+      }
+   }
+   return MOVE_NONE;
+}
+
+// Whether a move that came from elsewhere, like the other side of a network game, is one the rules allow. The
+// promotion piece is the mover's to pick; validMove() only returns queen promotions.
+bool allowedMove(Game &game, Move move) {
+   if (!move) {
+      return false;
+   }
+   Move legal = validMove(game, positionOf(moveFrom(move)), positionOf(moveTo(move)));
+   return legal && (legal == move || moveFlag(legal) == MOVE_PROMOTION);
+}
+
+// Check if validMove() beforehand.
+void movePiece(Game &game, Move move) {
+   // Keep what was generated this turn in case the position comes back.
+   if (game.moveCache) {
+      storeMoveCache(*game.moveCache, game.board.key, game.possibleMoves, game.movesGenerated);
+   }
+
+   Undo undo;
+   makeMove(game.board, move, undo);
+   pushPosition(game.history, game.board.key);
+   if (game.moveCount < MAX_GAME_MOVES) {
+      game.moves[game.moveCount++] = move;
+   }
+
+   // Todo: track captures
+
+   // See if the other king is checked, from what the move changed
+   game.check = givesCheck(game.board, move);
+
+   // Update previous move variables
+   game.prevMove = move;
+   game.turns++;
+
+   // Calculate all moves for next turn.
+   calculateAllMoves(game);
+}
+
+// Writes the game so far as PGN. Returns false if the file can't be written.
+bool saveGame(const Game &game, const char* path) {
+   const char* result = "*";
+   switch (game.end) {
+   case GAME_CHECKMATE:
+      result = (game.board.turn == white) ? "0-1" : "1-0";
+      break;
+   case GAME_STALEMATE:
+   case GAME_REPETITION:
+      result = "1/2-1/2";
+      break;
+   default:
+      break;
+   }
+   FILE* file = fopen(path, "w");
+   if (!file) {
+      return false;
+   }
+   PgnTags tags;
+   initPgnTags(tags);
+   tags.event = "chess3DS game";
+   writePgn(file, tags, game.startBoard, game.moves, game.moveCount, result);
+   return fclose(file) == 0;
+}
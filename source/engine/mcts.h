@@ -0,0 +1,238 @@
+#pragma once
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "movegen.h"
+
+// Plies a playout goes on for before it's called a draw
+#define PLAYOUT_MAX_PLIES 300
+// Deepest the tree is walked down
+#define MCTS_MAX_DEPTH 128
+// Exploration constant of the UCT formula
+#define MCTS_EXPLORATION 1.4f
+// childCount of a node whose moves haven't been generated yet
+#define MCTS_UNEXPANDED 0xFFFF
+
+// Points for white, the same as for black turned around: two for a win, one for a draw.
+enum PlayoutResult : u8 { PLAYOUT_BLACK_WINS, PLAYOUT_DRAW, PLAYOUT_WHITE_WINS };
+
+// Neither side can mate: only kings, and at most one knight or bishop.
+inline bool insufficientMaterial(const Board &board) {
+   for (u8 color = 0; color < 2; color++) {
+      if (board.pieces[color][pawn] | board.pieces[color][rook] | board.pieces[color][queen]) {
+         return false;
+      }
+   }
+   return popCount(board.pieces[white][knight] | board.pieces[white][bishop] | board.pieces[black][knight]
+      | board.pieces[black][bishop]) <= 1;
+}
+
+// Plays uniformly random legal moves until the game ends, and returns how. Checkmate and stalemate are the
+// same outcomes calculateAllMoves() announces; the fifty move rule, bare kings and PLAYOUT_MAX_PLIES end it
+// in a draw. Repetitions aren't looked for. Everything stays on the stack.
+//
+// Only the move that gets picked is checked for legality: an illegal pick is dropped and another one drawn,
+// which keeps the choice uniform over the legal moves, and running out of moves means mate or stalemate.
+PlayoutResult playout(Board &board, u64 &random, u16 &plies) {
+   MoveList moves;
+   for (plies = 0;; plies++) {
+      Legality legality;
+      calculateLegality(board, board.turn, legality);
+      moves.size = 0;
+      Bitboard pieces = board.colors[board.turn];
+      while (pieces) {
+         Position position = positionOf(popLowestSquare(pieces));
+         calculatePieceMoves(board, position, moves);
+      }
+
+      Move move = MOVE_NONE;
+      for (u16 left = moves.size; left && !move;) {
+         u16 i = nextRandom(random) % left;
+         if (legalMove(board, legality, moves.moves[i])) {
+            move = moves.moves[i];
+         }
+         else {
+            moves.moves[i] = moves.moves[--left];
+         }
+      }
+      if (!move) {
+         if (!legality.checkers) {
+            return PLAYOUT_DRAW;
+         }
+         return (board.turn == white) ? PLAYOUT_BLACK_WINS : PLAYOUT_WHITE_WINS;
+      }
+      if (plies >= PLAYOUT_MAX_PLIES || board.halfmoveClock >= 100 || insufficientMaterial(board)) {
+         return PLAYOUT_DRAW;
+      }
+      Undo undo;
+      makeMove(board, move, undo);
+   }
+}
+
+struct MctsNode {
+   // Move that leads here from the parent
+   Move move;
+   // Children are next to each other in the pool, from firstChild on
+   u16 childCount;
+   u32 firstChild;
+   u32 visits;
+   // Points the side that played the move got in the playouts through here, two for a win
+   u32 points;
+};
+
+// Monte Carlo tree search: every iteration walks down the tree picking moves by UCT, adds the children of the
+// node it ends on, and plays a random game out from there. Nodes come from a pool allocated once by initMcts(),
+// and the tree simply stops growing when it's full. Like the alpha-beta search, it runs a few playouts at a time
+// through continueMcts().
+struct Mcts {
+   Board board;
+   MctsNode* nodes;
+   u32 capacity;
+   u32 used;
+   u64 random;
+   // Limit, 0 for none
+   u64 maxPlayouts;
+   u64 playouts;
+   // Plies played in every playout, for the average
+   u64 playoutPlies;
+   bool finished;
+};
+
+// Allocates the node pool. Returns false if the memory isn't there.
+bool initMcts(Mcts &mcts, u32 megabytes) {
+   mcts.capacity = ((u64)megabytes << 20) / sizeof(MctsNode);
+   mcts.nodes = (MctsNode*)malloc((size_t)mcts.capacity * sizeof(MctsNode));
+   mcts.used = 0;
+   mcts.random = 0;
+   mcts.finished = true;
+   return mcts.nodes != NULL;
+}
+
+void freeMcts(Mcts &mcts) {
+   free(mcts.nodes);
+   mcts.nodes = NULL;
+   mcts.capacity = 0;
+}
+
+// Sets up a search of the position with the given random seed. maxPlayouts of 0 means no limit; it then runs
+// until stopMcts() is called.
+void startMcts(Mcts &mcts, const Board &board, u64 maxPlayouts, u64 seed) {
+   mcts.board = board;
+   mcts.maxPlayouts = maxPlayouts;
+   mcts.playouts = 0;
+   mcts.playoutPlies = 0;
+   mcts.random = seed;
+   mcts.finished = false;
+   MctsNode &root = mcts.nodes[0];
+   root.move = MOVE_NONE;
+   root.childCount = MCTS_UNEXPANDED;
+   root.visits = 0;
+   root.points = 0;
+   mcts.used = 1;
+}
+
+inline void stopMcts(Mcts &mcts) {
+   mcts.finished = true;
+}
+
+// Adds a child for every legal move. Returns false, leaving the node a leaf, if the pool is full.
+bool expandNode(Mcts &mcts, MctsNode &node, Board &board) {
+   MoveList moves;
+   calculateLegalMoves(board, moves);
+   if (mcts.used + moves.size > mcts.capacity) {
+      return false;
+   }
+   node.firstChild = mcts.used;
+   node.childCount = moves.size;
+   for (u16 i = 0; i < moves.size; i++) {
+      MctsNode &child = mcts.nodes[mcts.used++];
+      child.move = moves.moves[i];
+      child.childCount = MCTS_UNEXPANDED;
+      child.visits = 0;
+      child.points = 0;
+   }
+   return true;
+}
+
+// Child with the best upper confidence bound. Unvisited children go first.
+u32 selectChild(const Mcts &mcts, const MctsNode &node) {
+   float logVisits = logf((float)node.visits);
+   u32 best = node.firstChild;
+   float bestBound = -1;
+   for (u32 i = node.firstChild; i < node.firstChild + node.childCount; i++) {
+      const MctsNode &child = mcts.nodes[i];
+      if (!child.visits) {
+         return i;
+      }
+      float bound = child.points / (2.0f * child.visits) + MCTS_EXPLORATION * sqrtf(logVisits / child.visits);
+      if (bound > bestBound) {
+         bestBound = bound;
+         best = i;
+      }
+   }
+   return best;
+}
+
+void runIteration(Mcts &mcts) {
+   Board board = mcts.board;
+   u32 path[MCTS_MAX_DEPTH];
+   u8 depth = 0;
+   u32 index = 0;
+   path[depth++] = index;
+   // A node is expanded the second time it's reached, so a move played only once costs one node.
+   while (depth < MCTS_MAX_DEPTH) {
+      MctsNode &node = mcts.nodes[index];
+      if (node.childCount == MCTS_UNEXPANDED && ((node.visits == 0 && index != 0) || !expandNode(mcts, node, board))) {
+         break;
+      }
+      if (!node.childCount) {
+         break;
+      }
+      index = selectChild(mcts, node);
+      Undo undo;
+      makeMove(board, mcts.nodes[index].move, undo);
+      path[depth++] = index;
+   }
+
+   u16 plies;
+   PlayoutResult result = playout(board, mcts.random, plies);
+   mcts.playouts++;
+   mcts.playoutPlies += plies;
+
+   // The root's move was played by the side not to move in it, and the movers alternate from there.
+   Color mover = (Color)!mcts.board.turn;
+   for (u8 i = 0; i < depth; i++) {
+      MctsNode &node = mcts.nodes[path[i]];
+      node.visits++;
+      node.points += (mover == white) ? result : 2 - result;
+      mover = (Color)!mover;
+   }
+}
+
+// Runs at most the given number of playouts. Returns true once the search is over.
+bool continueMcts(Mcts &mcts, u32 playouts) {
+   for (; playouts && !mcts.finished; playouts--) {
+      if (mcts.maxPlayouts && mcts.playouts >= mcts.maxPlayouts) {
+         mcts.finished = true;
+         break;
+      }
+      runIteration(mcts);
+   }
+   return mcts.finished;
+}
+
+// The root's most visited move, the one the search trusts most, or MOVE_NONE if the game is over.
+Move bestMctsMove(const Mcts &mcts) {
+   const MctsNode &root = mcts.nodes[0];
+   if (root.childCount == MCTS_UNEXPANDED) {
+      return MOVE_NONE;
+   }
+   const MctsNode* best = NULL;
+   for (u32 i = root.firstChild; i < root.firstChild + root.childCount; i++) {
+      if (!best || mcts.nodes[i].visits > best->visits) {
+         best = &mcts.nodes[i];
+      }
+   }
+   return best ? best->move : MOVE_NONE;
+}
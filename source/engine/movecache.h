@@ -0,0 +1,46 @@
+#pragma once
+
+#include "movegen.h"
+
+// Must be a power of two.
+#define MOVE_CACHE_SIZE 64
+
+// Legal moves of recently seen positions, keyed by Zobrist key. An entry can hold the moves of only some
+// squares, as generated so far. Direct-mapped, so a position just replaces whatever was in its slot.
+// A zero key marks an empty slot.
+struct MoveCache {
+   u64 keys[MOVE_CACHE_SIZE];
+   // Squares whose moves the list holds
+   Bitboard generated[MOVE_CACHE_SIZE];
+   MoveList lists[MOVE_CACHE_SIZE];
+};
+
+inline void clearMoveCache(MoveCache &cache) {
+   memset(cache.keys, 0, sizeof(cache.keys));
+}
+
+// Copies only the part of the list in use.
+inline void copyMoves(MoveList &to, const MoveList &from) {
+   memcpy(to.moves, from.moves, from.size * sizeof(Move));
+   memcpy(to.first, from.first, sizeof(from.first));
+   memcpy(to.count, from.count, sizeof(from.count));
+   to.size = from.size;
+}
+
+// Returns if the position is cached, and if so fills the list and the squares it has moves for.
+bool probeMoveCache(const MoveCache &cache, u64 key, MoveList &moveList, Bitboard &generated) {
+   u8 slot = key & (MOVE_CACHE_SIZE - 1);
+   if (cache.keys[slot] != key) {
+      return false;
+   }
+   copyMoves(moveList, cache.lists[slot]);
+   generated = cache.generated[slot];
+   return true;
+}
+
+void storeMoveCache(MoveCache &cache, u64 key, const MoveList &moveList, Bitboard generated) {
+   u8 slot = key & (MOVE_CACHE_SIZE - 1);
+   cache.keys[slot] = key;
+   cache.generated[slot] = generated;
+   copyMoves(cache.lists[slot], moveList);
+}
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "board.h"
+
+// No chess position has more than 218 legal moves.
+#define MAX_MOVES 256
+
+// Legal moves, grouped by the square the piece starts on.
+struct MoveList {
+   Move moves[MAX_MOVES];
+   u16 size;
+   // [square], where the square's moves start in moves and how many there are
+   u8 first[64];
+   u8 count[64];
+};
+
+inline void clearMoves(MoveList &moveList) {
+   moveList.size = 0;
+   memset(moveList.count, 0, sizeof(moveList.count));
+}
+
+// Every square the color's pieces attack, with the given pieces treated as the occupied squares.
+Bitboard attackMap(const Board &board, Color color, Bitboard occupied) {
+   const Bitboard (&pieces)[7] = board.pieces[color];
+   Bitboard attacks = 0;
+   if (color == white) {
+      attacks |= ((pieces[pawn] & ~COLUMN_A) << 7) | ((pieces[pawn] & ~COLUMN_H) << 9);
+   }
+   else {
+      attacks |= ((pieces[pawn] & ~COLUMN_H) >> 7) | ((pieces[pawn] & ~COLUMN_A) >> 9);
+   }
+   Bitboard b = pieces[knight];
+   while (b) {
+      attacks |= knightAttacks[popLowestSquare(b)];
+   }
+   b = pieces[bishop] | pieces[queen];
+   while (b) {
+      attacks |= bishopAttacks(popLowestSquare(b), occupied);
+   }
+   b = pieces[rook] | pieces[queen];
+   while (b) {
+      attacks |= rookAttacks(popLowestSquare(b), occupied);
+   }
+   if (pieces[king]) {
+      attacks |= kingAttacks[lowestSquare(pieces[king])];
+   }
+   return attacks;
+}
+
+// Computed once per position so each move can be checked for legality without replaying it.
+struct Legality {
+   u8 king;
+   // Enemy pieces giving check
+   Bitboard checkers;
+   // Squares a non-king move has to land on to deal with a single check
+   Bitboard checkBlocks;
+   // Own pieces that can only move along the line between the king and an enemy slider
+   Bitboard pinned;
+   // Squares the enemy attacks, seen through the king so it can't step back along a checking line
+   Bitboard enemyAttacks;
+};
+
+void calculateLegality(const Board &board, Color color, Legality &legality) {
+   Color enemy = (Color)!color;
+   const Bitboard (&enemyPieces)[7] = board.pieces[enemy];
+   u8 king = kingSquare(board, color);
+   legality.king = king;
+
+   legality.checkers = ((pawnAttacks[color][king] & enemyPieces[pawn])
+      | (knightAttacks[king] & enemyPieces[knight])
+      | (bishopAttacks(king, board.occupied) & (enemyPieces[bishop] | enemyPieces[queen]))
+      | (rookAttacks(king, board.occupied) & (enemyPieces[rook] | enemyPieces[queen])));
+   legality.checkBlocks = 0;
+   if (legality.checkers) {
+      u8 checker = lowestSquare(legality.checkers);
+      legality.checkBlocks = legality.checkers | betweenSquares[king][checker];
+   }
+
+   // Sliders that would see the king if nothing was in between. Exactly one own piece between them means a pin.
+   legality.pinned = 0;
+   Bitboard snipers = (bishopAttacks(king, 0) & (enemyPieces[bishop] | enemyPieces[queen]))
+      | (rookAttacks(king, 0) & (enemyPieces[rook] | enemyPieces[queen]));
+   while (snipers) {
+      Bitboard blockers = betweenSquares[king][popLowestSquare(snipers)] & board.occupied;
+      if (popCount(blockers) == 1) {
+         legality.pinned |= blockers & board.colors[color];
+      }
+   }
+
+   legality.enemyAttacks = attackMap(board, enemy, board.occupied & ~BIT(king));
+}
+
+// Returns if a pseudo-legal move leaves the own king safe.
+bool legalMove(Board &board, const Legality &legality, Move move) {
+   u8 from = moveFrom(move);
+   u8 to = moveTo(move);
+   if (from == legality.king) {
+      // Castling can't start in, pass through or end in check.
+      if (moveFlag(move) == MOVE_CASTLING) {
+         return !(legality.enemyAttacks & (BIT(from) | BIT((from + to) / 2) | BIT(to)));
+      }
+      return !(legality.enemyAttacks & BIT(to));
+   }
+   // Only the king can get out of double check.
+   if (popCount(legality.checkers) > 1) {
+      return false;
+   }
+   if ((legality.pinned & BIT(from)) && !(lineThrough[legality.king][from] & BIT(to))) {
+      return false;
+   }
+   // En passant removes two pieces from the capturing row, so it is the one move still tried out.
+   if (moveFlag(move) == MOVE_EN_PASSANT) {
+      Color color = colorOn(board, from);
+      Undo undo;
+      makeMove(board, move, undo);
+      bool safe = !squareAttacked(board, legality.king, (Color)!color);
+      unmakeMove(board, move, undo);
+      return safe;
+   }
+   if (legality.checkers) {
+      return legality.checkBlocks & BIT(to);
+   }
+   return true;
+}
+
+// Appends the piece's pseudo-legal moves to the list and indexes them under its square.
+void calculatePieceMoves(const Board &board, Position& position, MoveList &moveList) {
+   u8 from = squareOf(position);
+   moveList.first[from] = moveList.size;
+   Color color = colorOn(board, from);
+   Bitboard own = board.colors[color];
+   Bitboard targets = 0;
+
+   switch (pieceOn(board, from)) {
+   case pawn: {
+      // If white, moves up (row increases). If black, moves down (row decreases).
+      u8 forward = (color == white) ? from + 8 : from - 8;
+      u8 startRow = (color == white) ? 1 : 6;
+
+      // Moving forward
+      if (!(board.occupied & BIT(forward))) {
+         targets |= BIT(forward);
+         // Can go forward 2 steps?
+         u8 doubleForward = (color == white) ? forward + 8 : forward - 8;
+         if (position.row == startRow && !(board.occupied & BIT(doubleForward))) {
+            targets |= BIT(doubleForward);
+         }
+      }
+      // Capturing
+      targets |= pawnAttacks[color][from] & board.colors[!color];
+
+      // Reaching the last row promotes to any of the four pieces.
+      if (targets & (ROW_1 | ROW_8)) {
+         while (targets) {
+            u8 to = popLowestSquare(targets);
+            moveList.moves[moveList.size++] = createMove(from, to, MOVE_PROMOTION, queen);
+            moveList.moves[moveList.size++] = createMove(from, to, MOVE_PROMOTION, rook);
+            moveList.moves[moveList.size++] = createMove(from, to, MOVE_PROMOTION, bishop);
+            moveList.moves[moveList.size++] = createMove(from, to, MOVE_PROMOTION, knight);
+         }
+      }
+
+      // En passant
+      if (board.enPassant >= 0 && (pawnAttacks[color][from] & BIT(board.enPassant))) {
+         moveList.moves[moveList.size++] = createMove(from, board.enPassant, MOVE_EN_PASSANT);
+      }
+      break;
+   }
+   case knight:
+      targets = knightAttacks[from] & ~own;
+      break;
+   case king:
+      targets = kingAttacks[from] & ~own;
+
+      // Castling. Whether the king passes through check is left to legalMove().
+      if (color == white) {
+         if ((board.castling & CASTLE_WHITE_LEFT) && !(board.occupied & 0x0EULL)) {
+            moveList.moves[moveList.size++] = createMove(from, from - 2, MOVE_CASTLING);
+         }
+         if ((board.castling & CASTLE_WHITE_RIGHT) && !(board.occupied & 0x60ULL)) {
+            moveList.moves[moveList.size++] = createMove(from, from + 2, MOVE_CASTLING);
+         }
+      }
+      else {
+         if ((board.castling & CASTLE_BLACK_LEFT) && !(board.occupied & 0x0E00000000000000ULL)) {
+            moveList.moves[moveList.size++] = createMove(from, from - 2, MOVE_CASTLING);
+         }
+         if ((board.castling & CASTLE_BLACK_RIGHT) && !(board.occupied & 0x6000000000000000ULL)) {
+            moveList.moves[moveList.size++] = createMove(from, from + 2, MOVE_CASTLING);
+         }
+      }
+      break;
+   case rook:
+      targets = rookAttacks(from, board.occupied) & ~own;
+      break;
+   case bishop:
+      targets = bishopAttacks(from, board.occupied) & ~own;
+      break;
+   case queen:
+      targets = queenAttacks(from, board.occupied) & ~own;
+      break;
+   default:
+      break;
+   }
+
+   while (targets) {
+      moveList.moves[moveList.size++] = createMove(from, popLowestSquare(targets));
+   }
+   moveList.count[from] = moveList.size - moveList.first[from];
+}
+
+// Appends the legal moves of the piece on the square, which has to belong to the side the legality is for.
+inline void calculateLegalPieceMoves(Board &board, const Legality &legality, u8 from, MoveList &moveList) {
+   Position passIn = positionOf(from);
+   calculatePieceMoves(board, passIn, moveList);
+
+   // Drop the moves that expose the king. They are the last ones in the list, so it can be compacted in place.
+   u16 kept = moveList.first[from];
+   for (u16 k = kept; k < moveList.size; k++) {
+      if (legalMove(board, legality, moveList.moves[k])) {
+         moveList.moves[kept++] = moveList.moves[k];
+      }
+   }
+   moveList.count[from] = kept - moveList.first[from];
+   moveList.size = kept;
+}
+
+// Fills the list with every legal move for the side to move.
+void calculateLegalMoves(Board &board, MoveList &moveList) {
+   Legality legality;
+   calculateLegality(board, board.turn, legality);
+
+   // Go through each of the player's pieces and store their potential moves
+   clearMoves(moveList);
+   Bitboard pieces = board.colors[board.turn];
+   while (pieces) {
+      calculateLegalPieceMoves(board, legality, popLowestSquare(pieces), moveList);
+   }
+}
+
+// Returns as soon as one legal move for the side to move is found. Enough to tell if the game is over.
+bool hasLegalMove(Board &board, const Legality &legality) {
+   // The king usually has a step to take, and it's the cheapest to check. Castling never needs looking at,
+   // since the step towards the rook is legal whenever castling is.
+   if (kingAttacks[legality.king] & ~board.colors[board.turn] & ~legality.enemyAttacks) {
+      return true;
+   }
+   MoveList moveList;
+   Bitboard pieces = board.colors[board.turn] & ~BIT(legality.king);
+   while (pieces) {
+      Position position = positionOf(popLowestSquare(pieces));
+      moveList.size = 0;
+      calculatePieceMoves(board, position, moveList);
+      for (u16 i = 0; i < moveList.size; i++) {
+         if (legalMove(board, legality, moveList.moves[i])) {
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+inline bool inCheck(const Board &board) {
+   return squareAttacked(board, kingSquare(board, board.turn), (Color)!board.turn);
+}
+
+// Same result as inCheck() right after makeMove(), but only looks at what the move changed. The king wasn't in
+// check before, so a check comes from the piece that arrived or from a line to the king opened up through a
+// square that was left.
+bool givesCheck(const Board &board, Move move) {
+   Color color = (Color)!board.turn;
+   const Bitboard (&pieces)[7] = board.pieces[color];
+   u8 king = kingSquare(board, board.turn);
+   u8 from = moveFrom(move);
+   u8 to = moveTo(move);
+
+   // Castling checks with the rook, en passant also empties the square of the taken pawn.
+   u8 arrived = to;
+   Bitboard vacated = BIT(from);
+   if (moveFlag(move) == MOVE_CASTLING) {
+      arrived = (to > from) ? from + 1 : from - 1;
+      vacated |= BIT((to > from) ? from + 3 : from - 4);
+   }
+   else if (moveFlag(move) == MOVE_EN_PASSANT) {
+      vacated |= BIT((color == white) ? to - 8 : to + 8);
+   }
+
+   // Direct check
+   Bitboard attacks = 0;
+   switch (pieceOn(board, arrived)) {
+   case pawn:
+      attacks = pawnAttacks[color][arrived];
+      break;
+   case knight:
+      attacks = knightAttacks[arrived];
+      break;
+   case bishop:
+      attacks = bishopAttacks(arrived, board.occupied);
+      break;
+   case rook:
+      attacks = rookAttacks(arrived, board.occupied);
+      break;
+   case queen:
+      attacks = queenAttacks(arrived, board.occupied);
+      break;
+   default:
+      break;
+   }
+   if (attacks & BIT(king)) {
+      return true;
+   }
+
+   // Discovered check, from a slider on one of the lines through the king and a vacated square
+   Bitboard lines = 0;
+   while (vacated) {
+      lines |= lineThrough[king][popLowestSquare(vacated)];
+   }
+   if (!lines) {
+      return false;
+   }
+   return ((bishopAttacks(king, board.occupied) & (pieces[bishop] | pieces[queen]))
+      | (rookAttacks(king, board.occupied) & (pieces[rook] | pieces[queen]))) & lines;
+}
+
+enum Outcome { ongoing, checkmate, stalemate };
+
+// What it means for the side to move to have the given legal moves.
+inline Outcome gameOutcome(const Board &board, const MoveList &moveList) {
+   if (moveList.size > 0) {
+      return ongoing;
+   }
+   return inCheck(board) ? checkmate : stalemate;
+}
+
+// Same, without needing every legal move.
+inline Outcome gameOutcome(Board &board, const Legality &legality) {
+   if (hasLegalMove(board, legality)) {
+      return ongoing;
+   }
+   return legality.checkers ? checkmate : stalemate;
+}
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "protocol.h"
+
+#ifndef _3DS
+#include <chrono>
+#include <thread>
+#endif
+
+// The client's side of the connection to the match server, on a thread of its own. The thread connects, says
+// hello, pings and does every send and recv; the game loop never touches the socket. What the server sends comes
+// to the game loop as NetEvents through one queue, and the game loop's moves go to the thread through another.
+// Each queue has one thread putting events in and one taking them out, so neither needs a lock.
+
+// Events a NetQueue holds, a power of two
+#define NET_QUEUE_SIZE 32
+// Longest the thread sleeps in poll(), and so the longest a queued move waits before it's sent
+#define NET_POLL_MS 2
+#define NET_CONNECT_TIMEOUT_US 5000000
+// A dead connection only shows when a send fails, so pings find one while nobody is moving.
+#define NET_PING_US 5000000
+#ifdef _3DS
+#define NET_STACK_SIZE 0x4000
+#endif
+// A server that went away is a failed send, not a signal.
+#ifdef MSG_NOSIGNAL
+#define NET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NET_SEND_FLAGS 0
+#endif
+
+enum NetEventType : u8 {
+   // Connected, and the hello is sent
+   NET_CONNECTED,
+   // A message from the server, or for it
+   NET_MESSAGE,
+   // The connection is over. The thread stops after this one.
+   NET_FAILED
+};
+
+enum NetFailure : u8 {
+   NET_FAILURE_CONNECT,
+   NET_FAILURE_TIMEOUT,
+   NET_FAILURE_SEND,
+   NET_FAILURE_RECV,
+   NET_FAILURE_CLOSED,
+   // The server speaks another protocol version
+   NET_FAILURE_VERSION,
+   NET_FAILURE_INVALID,
+   // The game loop stopped taking events or the server stopped reading
+   NET_FAILURE_OVERFLOW
+};
+
+struct NetEvent {
+   NetEventType type;
+   NetFailure failure;
+   u8 length;
+   u8 message[MAX_MESSAGE];
+   // errno for NET_FAILED, 0 if there's none
+   int error;
+   // netMicroseconds() when it was queued
+   u64 queuedAt;
+};
+
+// Single producer, single consumer. head is only written by the producer and tail only by the consumer, each
+// published with release and read with acquire, so an event is written before it's seen. The counters belong to
+// the side that updates them, and are for reading once the thread has stopped.
+struct NetQueue {
+   NetEvent events[NET_QUEUE_SIZE];
+   // Both only ever count up, like a RingBuffer's.
+   u32 head;
+   // Producer's counters: events that found the queue full, the most it held and the sum of what it held after
+   // each push
+   u32 full;
+   u32 maxDepth;
+   u64 depthTotal;
+   // Consumer's, on its own cache line: microseconds events waited in the queue
+   alignas(64) u32 tail;
+   u64 waitTotal;
+   u64 maxWait;
+};
+
+struct NetClient {
+   int sock;
+   // Server to game loop, and game loop to server
+   NetQueue inbound;
+   NetQueue outbound;
+   // The thread's own: bytes from the server not yet framed, and frames for it not yet sent
+   RingBuffer input;
+   RingBuffer output;
+   bool connected;
+   // Read and written with atomic operations, as the thread watches it
+   bool stop;
+   bool running;
+#ifdef _3DS
+   Thread thread;
+#else
+   std::thread thread;
+#endif
+};
+
+inline u64 netMicroseconds() {
+#ifdef _3DS
+   return svcGetSystemTick() / (SYSCLOCK_ARM11 / 1000000);
+#else
+   return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void clearNetQueue(NetQueue &queue) {
+   queue.head = 0;
+   queue.tail = 0;
+   queue.full = 0;
+   queue.maxDepth = 0;
+   queue.depthTotal = 0;
+   queue.waitTotal = 0;
+   queue.maxWait = 0;
+}
+
+inline u32 netQueueDepth(const NetQueue &queue) {
+   return __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE) - __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE);
+}
+
+// Producer side. Returns false if the queue is full.
+bool pushNetEvent(NetQueue &queue, const NetEvent &event) {
+   u32 head = queue.head;
+   u32 depth = head - __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE);
+   if (depth == NET_QUEUE_SIZE) {
+      queue.full++;
+      return false;
+   }
+   NetEvent &slot = queue.events[head % NET_QUEUE_SIZE];
+   slot = event;
+   slot.queuedAt = netMicroseconds();
+   __atomic_store_n(&queue.head, head + 1, __ATOMIC_RELEASE);
+   depth++;
+   if (depth > queue.maxDepth) {
+      queue.maxDepth = depth;
+   }
+   queue.depthTotal += depth;
+   return true;
+}
+
+// Consumer side. Returns false if the queue is empty.
+bool popNetEvent(NetQueue &queue, NetEvent &event) {
+   u32 tail = queue.tail;
+   if (tail == __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE)) {
+      return false;
+   }
+   event = queue.events[tail % NET_QUEUE_SIZE];
+   __atomic_store_n(&queue.tail, tail + 1, __ATOMIC_RELEASE);
+   u64 wait = netMicroseconds() - event.queuedAt;
+   queue.waitTotal += wait;
+   if (wait > queue.maxWait) {
+      queue.maxWait = wait;
+   }
+   return true;
+}
+
+inline bool netStopping(NetClient &client) {
+   return __atomic_load_n(&client.stop, __ATOMIC_RELAXED);
+}
+
+void netSleep(u32 milliseconds) {
+#ifdef _3DS
+   svcSleepThread((s64)milliseconds * 1000000);
+#else
+   std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+#endif
+}
+
+// Tells the game loop the connection is over, waiting for room if it has to.
+void failNetClient(NetClient &client, NetFailure failure, int error) {
+   NetEvent event;
+   event.type = NET_FAILED;
+   event.failure = failure;
+   event.length = 0;
+   event.error = error;
+   while (!pushNetEvent(client.inbound, event) && !netStopping(client)) {
+      netSleep(NET_POLL_MS);
+   }
+}
+
+// Sends what's queued, as much of it as the socket takes now. Returns false if the connection is gone.
+bool flushNetClient(NetClient &client) {
+   while (ringUsed(client.output)) {
+      u32 size;
+      const u8* data = ringData(client.output, size);
+      int sent = send(client.sock, data, size, NET_SEND_FLAGS);
+      if (sent < 0) {
+         return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+      }
+      ringRemoved(client.output, sent);
+   }
+   return true;
+}
+
+// Reads what arrived and passes every complete message on, as far as the game loop has room for them. What
+// doesn't fit stays in the input ring, and once that's full the socket isn't read until there's room again.
+// Returns false once it has failed the client.
+bool receiveNetClient(NetClient &client) {
+   while (true) {
+      u32 space;
+      u8* into = ringSpace(client.input, space);
+      int bytes = 0;
+      if (space) {
+         bytes = recv(client.sock, into, space, 0);
+         if (bytes < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+               failNetClient(client, NET_FAILURE_RECV, errno);
+               return false;
+            }
+         }
+         if (bytes == 0) {
+            failNetClient(client, NET_FAILURE_CLOSED, 0);
+            return false;
+         }
+         if (bytes > 0) {
+            ringAdded(client.input, bytes);
+         }
+      }
+      NetEvent event;
+      event.type = NET_MESSAGE;
+      event.error = 0;
+      FrameResult result = FRAME_INCOMPLETE;
+      while (NET_QUEUE_SIZE - netQueueDepth(client.inbound) && (result = readFrame(client.input, event.message, event.length)) == FRAME_READ) {
+         pushNetEvent(client.inbound, event);
+      }
+      if (result == FRAME_INVALID) {
+         failNetClient(client, (ringByte(client.input, 0) != PROTOCOL_VERSION) ? NET_FAILURE_VERSION : NET_FAILURE_INVALID, 0);
+         return false;
+      }
+      if (bytes <= 0 || (u32)bytes < space) {
+         return true;
+      }
+   }
+}
+
+// The thread. Runs until stopNetClient() or the connection fails.
+void runNetClient(NetClient* clientPointer) {
+   NetClient &client = *clientPointer;
+   u64 started = netMicroseconds();
+   u64 lastPing = started;
+   while (!netStopping(client)) {
+      struct pollfd event;
+      event.fd = client.sock;
+      if (!client.connected) {
+         event.events = POLLOUT;
+         int ready = poll(&event, 1, NET_POLL_MS);
+         if (ready > 0) {
+            int error = 0;
+            socklen_t size = sizeof(error);
+            getsockopt(client.sock, SOL_SOCKET, SO_ERROR, &error, &size);
+            if (error || !(event.revents & POLLOUT)) {
+               failNetClient(client, NET_FAILURE_CONNECT, error);
+               return;
+            }
+            client.connected = true;
+            lastPing = netMicroseconds();
+            u8 hello = MESSAGE_HELLO;
+            writeFrame(client.output, &hello, 1);
+            NetEvent connected;
+            connected.type = NET_CONNECTED;
+            connected.length = 0;
+            connected.error = 0;
+            pushNetEvent(client.inbound, connected);
+         }
+         else if (netMicroseconds() - started > NET_CONNECT_TIMEOUT_US) {
+            failNetClient(client, NET_FAILURE_TIMEOUT, 0);
+            return;
+         }
+         continue;
+      }
+
+      // The game loop's moves go out as soon as they're seen.
+      NetEvent move;
+      while (popNetEvent(client.outbound, move)) {
+         if (!writeFrame(client.output, move.message, move.length)) {
+            failNetClient(client, NET_FAILURE_OVERFLOW, 0);
+            return;
+         }
+      }
+      u64 now = netMicroseconds();
+      if (now - lastPing > NET_PING_US) {
+         lastPing = now;
+         u8 ping = MESSAGE_PING;
+         if (!writeFrame(client.output, &ping, 1)) {
+            failNetClient(client, NET_FAILURE_OVERFLOW, 0);
+            return;
+         }
+      }
+      if (!flushNetClient(client)) {
+         failNetClient(client, NET_FAILURE_SEND, errno);
+         return;
+      }
+
+      // With the input ring full there's nothing to read into, so only wait.
+      u32 space;
+      ringSpace(client.input, space);
+      event.events = (space ? POLLIN : 0) | (ringUsed(client.output) ? POLLOUT : 0);
+      int ready = poll(&event, 1, NET_POLL_MS);
+      if (ready < 0 && errno != EINTR) {
+         failNetClient(client, NET_FAILURE_RECV, errno);
+         return;
+      }
+      if ((ready > 0 || ringUsed(client.input)) && !receiveNetClient(client)) {
+         return;
+      }
+   }
+}
+
+#ifdef _3DS
+void netThreadEntry(void* client) {
+   runNetClient((NetClient*)client);
+}
+#endif
+
+// Starts connecting to the server and the thread that does it. Returns false with errno set if the socket or
+// the thread can't be made.
+bool startNetClient(NetClient &client, const char* address, u16 port) {
+   clearNetQueue(client.inbound);
+   clearNetQueue(client.outbound);
+   clearRing(client.input);
+   clearRing(client.output);
+   client.connected = false;
+   client.stop = false;
+   client.running = false;
+
+   client.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+   if (client.sock < 0) {
+      return false;
+   }
+   fcntl(client.sock, F_SETFL, fcntl(client.sock, F_GETFL, 0) | O_NONBLOCK);
+
+   struct sockaddr_in server;
+   memset(&server, 0, sizeof(server));
+   server.sin_addr.s_addr = inet_addr(address);
+   server.sin_family = AF_INET;
+   server.sin_port = htons(port);
+   if (connect(client.sock, (struct sockaddr*)&server, sizeof(server)) < 0 && errno != EWOULDBLOCK && errno != EINPROGRESS) {
+      close(client.sock);
+      client.sock = -1;
+      return false;
+   }
+
+#ifdef _3DS
+   // Above the game loop's priority, so what arrives is taken in as soon as it's there. The thread spends
+   // nearly all its time waiting in poll().
+   s32 priority = 0x30;
+   svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+   client.thread = threadCreate(netThreadEntry, &client, NET_STACK_SIZE, priority - 1, -1, false);
+   if (!client.thread) {
+      close(client.sock);
+      client.sock = -1;
+      errno = ENOMEM;
+      return false;
+   }
+#else
+   client.thread = std::thread(runNetClient, &client);
+#endif
+   client.running = true;
+   return true;
+}
+
+// Stops the thread and closes the connection. Does nothing if the client isn't running.
+void stopNetClient(NetClient &client) {
+   if (!client.running) {
+      return;
+   }
+   __atomic_store_n(&client.stop, true, __ATOMIC_RELAXED);
+#ifdef _3DS
+   threadJoin(client.thread, U64_MAX);
+   threadFree(client.thread);
+#else
+   client.thread.join();
+#endif
+   close(client.sock);
+   client.sock = -1;
+   client.running = false;
+}
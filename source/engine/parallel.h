@@ -0,0 +1,155 @@
+#pragma once
+
+#include "search.h"
+
+#ifndef _3DS
+#include <thread>
+#endif
+
+#define MAX_THREADS 64
+
+// Nodes a helper searches between looks at the stop flag
+#define HELPER_NODES_PER_CHECK 1024
+
+// Lazy SMP: the same search run on several threads at once, sharing one transposition table. The helpers mostly
+// fill the table with results the main search then finds, so only the main search's move counts. The main
+// search runs on whichever thread calls continueParallelSearch(), a slice at a time like a single search.
+// The 3DS build always has just the main search.
+struct ParallelSearch {
+   // [thread], 0 is the main search
+   Search* searches;
+   u8 threadCount;
+   TranspositionTable* table;
+#ifndef _3DS
+   std::thread helpers[MAX_THREADS];
+#endif
+   // [thread], node counts the helpers publish for parallelNodes()
+   u64 helperNodes[MAX_THREADS];
+   // Read and written with atomic operations, as the helpers watch it
+   bool stop;
+   bool running;
+};
+
+// Allocates a search for each thread. Like initTable(), meant to be called once at startup.
+bool initParallelSearch(ParallelSearch &parallel, u8 threadCount, TranspositionTable* table) {
+#ifdef _3DS
+   threadCount = 1;
+#endif
+   if (!threadCount) {
+      threadCount = 1;
+   }
+   if (threadCount > MAX_THREADS) {
+      threadCount = MAX_THREADS;
+   }
+   parallel.searches = (Search*)calloc(threadCount, sizeof(Search));
+   if (!parallel.searches) {
+      return false;
+   }
+   parallel.threadCount = threadCount;
+   parallel.table = table;
+   for (u8 i = 0; i < threadCount; i++) {
+      parallel.searches[i].table = table;
+   }
+   parallel.running = false;
+   return true;
+}
+
+// Lets every thread look endgames up in the tablebases, NULL for none.
+void setParallelTablebases(ParallelSearch &parallel, const TablebaseSet* tablebases) {
+   for (u8 i = 0; i < parallel.threadCount; i++) {
+      parallel.searches[i].tablebases = tablebases;
+   }
+}
+
+void freeParallelSearch(ParallelSearch &parallel) {
+   free(parallel.searches);
+   parallel.searches = NULL;
+}
+
+inline Search& mainSearch(ParallelSearch &parallel) {
+   return parallel.searches[0];
+}
+
+void helperThread(ParallelSearch* parallel, u8 index) {
+   Search &search = parallel->searches[index];
+   while (!__atomic_load_n(&parallel->stop, __ATOMIC_RELAXED) && !continueSearch(search, HELPER_NODES_PER_CHECK)) {
+      __atomic_store_n(&parallel->helperNodes[index], search.nodes, __ATOMIC_RELAXED);
+   }
+   __atomic_store_n(&parallel->helperNodes[index], search.nodes, __ATOMIC_RELAXED);
+}
+
+// Starts every thread on the position. maxNodes only limits the main search.
+void startParallelSearch(ParallelSearch &parallel, const Board &board, const PositionHistory &history, u8 maxDepth, u64 maxNodes) {
+   if (parallel.table) {
+      newTableGeneration(*parallel.table);
+   }
+   for (u8 i = 0; i < parallel.threadCount; i++) {
+      Search &search = parallel.searches[i];
+      startSearch(search, board, history, maxDepth, i ? 0 : maxNodes);
+      // Every other helper starts a ply deeper, so they don't all search the same tree in step.
+      if ((i & 1) && search.maxDepth > 1) {
+         startIteration(search, 2);
+      }
+      parallel.helperNodes[i] = 0;
+   }
+   parallel.stop = false;
+#ifndef _3DS
+   for (u8 i = 1; i < parallel.threadCount; i++) {
+      parallel.helpers[i] = std::thread(helperThread, &parallel, i);
+   }
+#endif
+   parallel.running = true;
+}
+
+// Ends the search on every thread, waiting for the helpers to stop.
+void stopParallelSearch(ParallelSearch &parallel) {
+   stopSearch(mainSearch(parallel));
+   if (!parallel.running) {
+      return;
+   }
+   __atomic_store_n(&parallel.stop, true, __ATOMIC_RELAXED);
+#ifndef _3DS
+   for (u8 i = 1; i < parallel.threadCount; i++) {
+      parallel.helpers[i].join();
+   }
+#endif
+   parallel.running = false;
+}
+
+// Searches at most the given number of nodes of the main search, the same as continueSearch(). Once the
+// main search is over, so are the helpers.
+bool continueParallelSearch(ParallelSearch &parallel, u32 nodes) {
+   if (continueSearch(mainSearch(parallel), nodes)) {
+      stopParallelSearch(parallel);
+      return true;
+   }
+   return false;
+}
+
+// Nodes searched by all threads. While the search runs, the helpers' part can be a few thousand nodes behind.
+u64 parallelNodes(const ParallelSearch &parallel) {
+   u64 nodes = parallel.searches[0].nodes;
+   for (u8 i = 1; i < parallel.threadCount; i++) {
+      nodes += __atomic_load_n(&parallel.helperNodes[i], __ATOMIC_RELAXED);
+   }
+   return nodes;
+}
+
+// Tablebase hits of all threads. Only once the search is over.
+u64 parallelTablebaseHits(const ParallelSearch &parallel) {
+   u64 hits = 0;
+   for (u8 i = 0; i < parallel.threadCount; i++) {
+      hits += parallel.searches[i].tablebaseHits;
+   }
+   return hits;
+}
+
+// Table statistics of all threads. Only once the search is over.
+TableStats parallelTableStats(const ParallelSearch &parallel) {
+   TableStats total;
+   memset(&total, 0, sizeof(total));
+   for (u8 i = 0; i < parallel.threadCount; i++) {
+      addTableStats(total, parallel.searches[i].tableStats);
+   }
+   return total;
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "fen.h"
+#include "san.h"
+
+// Longest tag value or move the reader keeps, longer ones are cut short
+#define PGN_TEXT_SIZE 256
+
+// Column writePgn() wraps the moves at
+#define PGN_LINE_LENGTH 79
+
+enum PgnToken : u8 { PGN_END, PGN_TAG, PGN_MOVE, PGN_RESULT };
+
+// Reads PGN a token at a time straight from the file, so files of any size go through in constant memory.
+// Comments, variations, move numbers and annotation glyphs are skipped. A game is its tags, its moves and the
+// result that ends it.
+struct PgnReader {
+   FILE* file;
+   // Line of the file the last token was on, for error messages
+   u32 line;
+   // Bytes read from the file, and where the last token started
+   u64 offset;
+   u64 tokenOffset;
+   // Name of the last tag
+   char tag[32];
+   // Value of the last tag, or the last move or result
+   char text[PGN_TEXT_SIZE];
+};
+
+// The file can be positioned anywhere, at the given offset, so parts of one file can be read separately.
+inline void initPgnReader(PgnReader &reader, FILE* file, u64 offset = 0) {
+   reader.file = file;
+   reader.line = 1;
+   reader.offset = offset;
+   reader.tokenOffset = offset;
+   reader.tag[0] = '\0';
+   reader.text[0] = '\0';
+}
+
+inline int readPgnChar(PgnReader &reader) {
+   int c = getc(reader.file);
+   if (c == '\n') {
+      reader.line++;
+   }
+   if (c != EOF) {
+      reader.offset++;
+   }
+   return c;
+}
+
+inline void unreadPgnChar(PgnReader &reader, int c) {
+   if (c == '\n') {
+      reader.line--;
+   }
+   reader.offset--;
+   ungetc(c, reader.file);
+}
+
+// Skips to the end of a comment in braces or of a line comment.
+inline void skipPgnComment(PgnReader &reader, int end) {
+   int c;
+   while ((c = readPgnChar(reader)) != EOF && c != end) {}
+}
+
+void skipPgnVariation(PgnReader &reader) {
+   int c;
+   u32 depth = 1;
+   while (depth && (c = readPgnChar(reader)) != EOF) {
+      if (c == '(') {
+         depth++;
+      }
+      else if (c == ')') {
+         depth--;
+      }
+      else if (c == '{') {
+         skipPgnComment(reader, '}');
+      }
+      else if (c == ';') {
+         skipPgnComment(reader, '\n');
+      }
+   }
+}
+
+// Reads "[Name "value"]" after the opening bracket.
+void readPgnTag(PgnReader &reader) {
+   int c;
+   u8 length = 0;
+   while ((c = readPgnChar(reader)) != EOF && c != '"' && c != ']') {
+      if (c != ' ' && c != '\t' && length < sizeof(reader.tag) - 1) {
+         reader.tag[length++] = c;
+      }
+   }
+   reader.tag[length] = '\0';
+
+   u16 valueLength = 0;
+   if (c == '"') {
+      while ((c = readPgnChar(reader)) != EOF && c != '"' && c != '\n') {
+         if (c == '\\') {
+            c = readPgnChar(reader);
+         }
+         if (valueLength < PGN_TEXT_SIZE - 1) {
+            reader.text[valueLength++] = c;
+         }
+      }
+      while (c != EOF && c != ']' && c != '\n') {
+         c = readPgnChar(reader);
+      }
+   }
+   reader.text[valueLength] = '\0';
+}
+
+inline bool isPgnResult(const char* text) {
+   return !strcmp(text, "1-0") || !strcmp(text, "0-1") || !strcmp(text, "1/2-1/2") || !strcmp(text, "*");
+}
+
+// Reads the next tag, move or result into the reader, or returns PGN_END at the end of the file.
+PgnToken nextPgnToken(PgnReader &reader) {
+   while (true) {
+      int c = readPgnChar(reader);
+      reader.tokenOffset = reader.offset - 1;
+      switch (c) {
+      case EOF:
+         return PGN_END;
+      case ' ': case '\t': case '\r': case '\n': case ')': case ']':
+         continue;
+      case '[':
+         readPgnTag(reader);
+         return PGN_TAG;
+      case '{':
+         skipPgnComment(reader, '}');
+         continue;
+      case ';': case '%':
+         skipPgnComment(reader, '\n');
+         continue;
+      case '(':
+         skipPgnVariation(reader);
+         continue;
+      }
+
+      u16 length = 0;
+      while (c != EOF && !strchr(" \t\r\n{}();[]", c)) {
+         if (length < PGN_TEXT_SIZE - 1) {
+            reader.text[length++] = c;
+         }
+         c = readPgnChar(reader);
+      }
+      if (c != EOF) {
+         unreadPgnChar(reader, c);
+      }
+      reader.text[length] = '\0';
+
+      if (isPgnResult(reader.text)) {
+         return PGN_RESULT;
+      }
+      // Move numbers ("12." or "12...") can have the move stuck to them. A number without a dot is castling
+      // written with zeroes.
+      char* move = reader.text;
+      while (*move >= '0' && *move <= '9') {
+         move++;
+      }
+      if (*move == '.') {
+         while (*move == '.') {
+            move++;
+         }
+         memmove(reader.text, move, strlen(move) + 1);
+      }
+      // Numeric annotation glyphs ($1) and annotations written apart from the move (!?)
+      if (!reader.text[0] || strchr("$!?", reader.text[0])) {
+         continue;
+      }
+      return PGN_MOVE;
+   }
+}
+
+// Tags writePgn() writes besides the result and the start position. Unknown ones are "?".
+struct PgnTags {
+   const char* event;
+   const char* site;
+   const char* date;
+   const char* round;
+   const char* white;
+   const char* black;
+   // Why the game ended, only written if there is one
+   const char* termination;
+};
+
+inline void initPgnTags(PgnTags &tags) {
+   tags.event = tags.site = tags.round = tags.white = tags.black = "?";
+   tags.date = "????.??.??";
+   tags.termination = NULL;
+}
+
+// Writes a game with the Seven Tag Roster. A game that didn't start from the start position gets the position in
+// a FEN tag. The moves have to be legal from the start board, and are numbered from 1.
+void writePgn(FILE* file, const PgnTags &tags, const Board &start, const Move* moves, u16 count, const char* result) {
+   fprintf(file, "[Event \"%s\"]\n[Site \"%s\"]\n[Date \"%s\"]\n[Round \"%s\"]\n", tags.event, tags.site, tags.date, tags.round);
+   fprintf(file, "[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n", tags.white, tags.black, result);
+   Board board;
+   setupStartPosition(board);
+   if (start.key != board.key) {
+      char fen[FEN_SIZE];
+      fprintf(file, "[SetUp \"1\"]\n[FEN \"%s\"]\n", writeFen(start, 1, fen));
+   }
+   if (tags.termination) {
+      fprintf(file, "[Termination \"%s\"]\n", tags.termination);
+   }
+   fprintf(file, "\n");
+
+   board = start;
+   u16 column = 0;
+   for (u16 i = 0; i <= count; i++) {
+      // Move numbers go before white's moves, and before the first move when black starts.
+      char word[8 + SAN_SIZE];
+      u8 length = 0;
+      u16 number = (i + (start.turn == black)) / 2 + 1;
+      if (i == count) {
+         length = snprintf(word, sizeof(word), "%s", result);
+      }
+      else if (board.turn == white) {
+         length = snprintf(word, sizeof(word), "%u. ", number);
+      }
+      else if (i == 0) {
+         length = snprintf(word, sizeof(word), "%u... ", number);
+      }
+      if (i < count) {
+         MoveList moveList;
+         calculateLegalMoves(board, moveList);
+         char san[SAN_SIZE];
+         length += snprintf(word + length, sizeof(word) - length, "%s", moveToSan(board, moveList, moves[i], san));
+         Undo undo;
+         makeMove(board, moves[i], undo);
+      }
+
+      if (column && column + 1 + length > PGN_LINE_LENGTH) {
+         fprintf(file, "\n");
+         column = 0;
+      }
+      else if (column) {
+         fprintf(file, " ");
+         column++;
+      }
+      fprintf(file, "%s", word);
+      column += length;
+   }
+   fprintf(file, "\n\n");
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "board.h"
+
+// Messages between the 3DS and the match server. The 3DS says hello once connected, then sends its moves and
+// pings; the server sends the game start, whose turn it is, the opponent's moves and the game over.
+//
+// Every message goes in a frame: the protocol version, the length of the message, then the message, whose first
+// byte says what it is. TCP hands over bytes, not messages, so both sides collect what arrives in a RingBuffer
+// and take out every complete frame; several frames can go out in one send. Version 1 had no frames, and its
+// clients open with a bare hello byte.
+
+#define PROTOCOL_PORT 8000
+#define PROTOCOL_VERSION 2
+// Longest message, a move with a promotion
+#define MAX_MESSAGE 6
+// Version and length
+#define FRAME_HEADER 2
+#define MAX_FRAME (FRAME_HEADER + MAX_MESSAGE)
+// Bytes a RingBuffer holds, a power of two
+#define RING_SIZE 256
+
+enum MessageType : u8 {
+   // Color of the receiver
+   MESSAGE_GAME_START = 0x00,
+   // Color to move
+   MESSAGE_TURN = 0x01,
+   // Start column, start row, end column, end row, and the piece only for promotions
+   MESSAGE_MOVE = 0x02,
+   // GameOverReason, then for GAME_OVER_WIN the winner's color and for GAME_OVER_ILLEGAL_MOVE the offender's
+   MESSAGE_GAME_OVER = 0x03,
+   MESSAGE_PING = 0x10,
+   MESSAGE_HELLO = 0x3D
+};
+
+enum GameOverReason : u8 {
+   GAME_OVER_ERROR,
+   GAME_OVER_DRAW,
+   GAME_OVER_WIN,
+   GAME_OVER_ILLEGAL_MOVE,
+   // The other side speaks another protocol version
+   GAME_OVER_VERSION,
+   // Number of reasons
+   GAME_OVER_REASONS
+};
+
+enum FrameResult : u8 { FRAME_INCOMPLETE, FRAME_READ, FRAME_INVALID };
+
+struct RingBuffer {
+   u8 bytes[RING_SIZE];
+   // Both only ever count up, so head - tail is what's stored.
+   u32 head;
+   u32 tail;
+};
+
+inline void clearRing(RingBuffer &ring) {
+   ring.head = 0;
+   ring.tail = 0;
+}
+
+inline u32 ringUsed(const RingBuffer &ring) {
+   return ring.head - ring.tail;
+}
+
+// Where the next bytes go, and how many fit there without wrapping, for recv() to write into.
+inline u8* ringSpace(RingBuffer &ring, u32 &size) {
+   u32 offset = ring.head % RING_SIZE;
+   size = RING_SIZE - offset;
+   if (size > RING_SIZE - ringUsed(ring)) {
+      size = RING_SIZE - ringUsed(ring);
+   }
+   return ring.bytes + offset;
+}
+
+// The oldest bytes, and how many follow them without wrapping, for send() to read from.
+inline const u8* ringData(const RingBuffer &ring, u32 &size) {
+   u32 offset = ring.tail % RING_SIZE;
+   size = RING_SIZE - offset;
+   if (size > ringUsed(ring)) {
+      size = ringUsed(ring);
+   }
+   return ring.bytes + offset;
+}
+
+inline void ringAdded(RingBuffer &ring, u32 size) {
+   ring.head += size;
+}
+
+inline void ringRemoved(RingBuffer &ring, u32 size) {
+   ring.tail += size;
+}
+
+inline u8 ringByte(const RingBuffer &ring, u32 offset) {
+   return ring.bytes[(ring.tail + offset) % RING_SIZE];
+}
+
+// Appends the bytes, all or none. Returns false if they don't fit.
+bool ringWrite(RingBuffer &ring, const u8* bytes, u32 size) {
+   if (RING_SIZE - ringUsed(ring) < size) {
+      return false;
+   }
+   for (u32 i = 0; i < size; i++) {
+      ring.bytes[ring.head++ % RING_SIZE] = bytes[i];
+   }
+   return true;
+}
+
+// Whether the message has the length its type calls for, and its squares are on the board.
+bool validMessage(const u8* message, u8 length) {
+   switch (message[0]) {
+   case MESSAGE_HELLO:
+   case MESSAGE_PING:
+      return length == 1;
+   case MESSAGE_GAME_START:
+   case MESSAGE_TURN:
+      return length == 2;
+   case MESSAGE_GAME_OVER:
+      return length == ((message[1] == GAME_OVER_WIN || message[1] == GAME_OVER_ILLEGAL_MOVE) ? 3 : 2);
+   case MESSAGE_MOVE:
+      return (length == 5 || length == 6) && message[1] < 8 && message[2] < 8 && message[3] < 8 && message[4] < 8;
+   default:
+      return false;
+   }
+}
+
+// Takes the oldest frame out of the ring and copies its message out. A frame of another version or with a
+// message that isn't valid is left where it is.
+FrameResult readFrame(RingBuffer &ring, u8 (&message)[MAX_MESSAGE], u8 &length) {
+   u32 used = ringUsed(ring);
+   if (used < FRAME_HEADER) {
+      return (used && ringByte(ring, 0) != PROTOCOL_VERSION) ? FRAME_INVALID : FRAME_INCOMPLETE;
+   }
+   length = ringByte(ring, 1);
+   if (ringByte(ring, 0) != PROTOCOL_VERSION || !length || length > MAX_MESSAGE) {
+      return FRAME_INVALID;
+   }
+   if (used < (u32)FRAME_HEADER + length) {
+      return FRAME_INCOMPLETE;
+   }
+   for (u8 i = 0; i < length; i++) {
+      message[i] = ringByte(ring, FRAME_HEADER + i);
+   }
+   if (!validMessage(message, length)) {
+      return FRAME_INVALID;
+   }
+   ringRemoved(ring, FRAME_HEADER + length);
+   return FRAME_READ;
+}
+
+// Queues the message in a frame, to go out with whatever else is queued. Returns false if the ring is full.
+bool writeFrame(RingBuffer &ring, const u8* message, u8 length) {
+   u8 frame[MAX_FRAME] = { PROTOCOL_VERSION, length };
+   memcpy(frame + FRAME_HEADER, message, length);
+   return ringWrite(ring, frame, FRAME_HEADER + length);
+}
+
+// Writes the move message and returns its length.
+u8 writeMoveMessage(u8 (&bytes)[MAX_MESSAGE], Move move) {
+   Position start = positionOf(moveFrom(move));
+   Position end = positionOf(moveTo(move));
+   bytes[0] = MESSAGE_MOVE;
+   bytes[1] = start.column;
+   bytes[2] = start.row;
+   bytes[3] = end.column;
+   bytes[4] = end.row;
+   if (moveFlag(move) != MOVE_PROMOTION) {
+      return 5;
+   }
+   bytes[5] = movePromotion(move);
+   return 6;
+}
+
+// The move of a valid move message, as played on the board. MOVE_NONE if the promotion isn't a piece a pawn
+// can turn into, or a pawn reaching the last row has none.
+Move readMoveMessage(const u8* bytes, u8 length, const Board &board) {
+   u8 from = bytes[2] * 8 + bytes[1];
+   u8 to = bytes[4] * 8 + bytes[3];
+   Piece promotion = (length == 6) ? (Piece)bytes[5] : none;
+   if (length == 6 && (promotion < queen || promotion > bishop)) {
+      return MOVE_NONE;
+   }
+   if (!promotion && pieceOn(board, from) == pawn && (to < 8 || to >= 56)) {
+      return MOVE_NONE;
+   }
+   return inferMove(board, from, to, promotion);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "movegen.h"
+
+// Longest move moveToSan() can write ("Qa1xb2+" or "exd8=Q#"), with its terminator
+#define SAN_SIZE 8
+
+// Finds the legal move written in standard algebraic notation (e4, Nbd7, exd6, e8=Q, O-O), or MOVE_NONE if no
+// legal move or more than one fits. Check marks and annotations (+, #, !, ?) are ignored, as are a missing
+// capture mark and zeroes in castling. A pawn reaching the last row without a promotion piece promotes to a
+// queen.
+Move parseSan(const Board &board, const MoveList &moveList, const char* text) {
+   const char PIECE_LETTERS[] = " KQRNB";
+   char san[16];
+   u8 length = 0;
+   for (; *text && length < sizeof(san) - 1; text++) {
+      if (!strchr("+#!?x:-=", *text)) {
+         san[length++] = *text;
+      }
+   }
+   san[length] = '\0';
+
+   // Castling, with the dashes dropped above
+   if (!strcmp(san, "OO") || !strcmp(san, "00") || !strcmp(san, "OOO") || !strcmp(san, "000")) {
+      bool left = length == 3;
+      u8 from = kingSquare(board, board.turn);
+      for (u16 i = moveList.first[from]; i < moveList.first[from] + moveList.count[from]; i++) {
+         Move move = moveList.moves[i];
+         if (moveFlag(move) == MOVE_CASTLING && (moveTo(move) < from) == left) {
+            return move;
+         }
+      }
+      return MOVE_NONE;
+   }
+
+   Piece piece = pawn;
+   u8 start = 0;
+   if (length && strchr(PIECE_LETTERS + 1, san[0])) {
+      piece = (Piece)(strchr(PIECE_LETTERS, san[0]) - PIECE_LETTERS);
+      start = 1;
+   }
+   Piece promotion = none;
+   if (piece == pawn && length > start && strchr("QRNBqrnb", san[length - 1])) {
+      promotion = (Piece)(strchr(PIECE_LETTERS, san[length - 1] & ~0x20) - PIECE_LETTERS);
+      length--;
+   }
+   if (length < start + 2) {
+      return MOVE_NONE;
+   }
+
+   // The destination is the last square, anything between the piece and it tells apart pieces that could go.
+   char toColumn = san[length - 2];
+   char toRow = san[length - 1];
+   if (toColumn < 'a' || toColumn > 'h' || toRow < '1' || toRow > '8') {
+      return MOVE_NONE;
+   }
+   u8 to = (toRow - '1') * 8 + (toColumn - 'a');
+   s8 fromColumn = -1;
+   s8 fromRow = -1;
+   for (u8 i = start; i < length - 2; i++) {
+      if (san[i] >= 'a' && san[i] <= 'h') {
+         fromColumn = san[i] - 'a';
+      }
+      else if (san[i] >= '1' && san[i] <= '8') {
+         fromRow = san[i] - '1';
+      }
+      else {
+         return MOVE_NONE;
+      }
+   }
+
+   Move found = MOVE_NONE;
+   for (u16 i = 0; i < moveList.size; i++) {
+      Move move = moveList.moves[i];
+      u8 from = moveFrom(move);
+      if (moveTo(move) != to || pieceOn(board, from) != piece || moveFlag(move) == MOVE_CASTLING
+         || (fromColumn >= 0 && from % 8 != fromColumn) || (fromRow >= 0 && from / 8 != fromRow)
+         || (movePromotion(move) && movePromotion(move) != (promotion ? promotion : queen))) {
+         continue;
+      }
+      if (found) {
+         return MOVE_NONE;
+      }
+      found = move;
+   }
+   return found;
+}
+
+// Writes a legal move in standard algebraic notation, with the check or mate mark, and returns the string. The
+// move list has to be the position's legal moves, to find the pieces the move needs telling apart from.
+char* moveToSan(Board &board, const MoveList &moveList, Move move, char (&text)[SAN_SIZE]) {
+   const char PIECE_LETTERS[] = " KQRNB";
+   u8 from = moveFrom(move);
+   u8 to = moveTo(move);
+   Piece piece = pieceOn(board, from);
+   char* out = text;
+   if (moveFlag(move) == MOVE_CASTLING) {
+      strcpy(out, (to > from) ? "O-O" : "O-O-O");
+      out += strlen(out);
+   }
+   else {
+      bool capture = pieceOn(board, to) || moveFlag(move) == MOVE_EN_PASSANT;
+      if (piece == pawn) {
+         if (capture) {
+            *out++ = 'a' + from % 8;
+         }
+      }
+      else {
+         *out++ = PIECE_LETTERS[piece];
+         // The column tells the pieces apart unless one shares it, then the row, then both.
+         bool ambiguous = false;
+         bool sameColumn = false;
+         bool sameRow = false;
+         for (u16 i = 0; i < moveList.size; i++) {
+            u8 other = moveFrom(moveList.moves[i]);
+            if (other != from && moveTo(moveList.moves[i]) == to && pieceOn(board, other) == piece) {
+               ambiguous = true;
+               sameColumn |= other % 8 == from % 8;
+               sameRow |= other / 8 == from / 8;
+            }
+         }
+         if (ambiguous && (!sameColumn || sameRow)) {
+            *out++ = 'a' + from % 8;
+         }
+         if (ambiguous && sameColumn) {
+            *out++ = '1' + from / 8;
+         }
+      }
+      if (capture) {
+         *out++ = 'x';
+      }
+      *out++ = 'a' + to % 8;
+      *out++ = '1' + to / 8;
+      if (movePromotion(move)) {
+         *out++ = '=';
+         *out++ = PIECE_LETTERS[movePromotion(move)];
+      }
+   }
+
+   Undo undo;
+   makeMove(board, move, undo);
+   if (inCheck(board)) {
+      Legality legality;
+      calculateLegality(board, board.turn, legality);
+      *out++ = hasLegalMove(board, legality) ? '+' : '#';
+   }
+   unmakeMove(board, move, undo);
+   *out = '\0';
+   return text;
+}
@@ -0,0 +1,346 @@
+#pragma once
+
+#include "movegen.h"
+#include "evaluate.h"
+#include "table.h"
+#include "tablebase.h"
+
+// Deepest the search goes, quiescence included
+#define MAX_PLY 64
+
+// Being mated in n plies scores -MATE_SCORE + n.
+const s16 MATE_SCORE = 30000;
+// Scores beyond this are mates: found by the search, within MAX_PLY, or by a tablebase from a node up to MAX_PLY
+// deep, up to 254 plies further on.
+const s16 MATE_BOUND = MATE_SCORE - MAX_PLY - 2 * 127;
+const s16 INFINITE_SCORE = 32000;
+
+enum FrameState : u8 { FRAME_ENTER, FRAME_NEXT };
+
+// One ply of the search. The search keeps these on its own stack instead of recursing, so it can stop after
+// any node and carry on from there the next time it's called.
+struct SearchFrame {
+   MoveList moves;
+   // [move], for ordering
+   s16 scores[MAX_MOVES];
+   // Index of the next move to search
+   u16 next;
+   s16 alpha;
+   s16 beta;
+   s16 best;
+   // Zero or less is quiescence: only captures and promotions, unless in check.
+   s8 depth;
+   FrameState state;
+   // The move being searched from this ply, and what makeMove() needs to take it back
+   Move move;
+   Undo undo;
+   // Move that raised alpha, and the best move the table had for the position
+   Move bestMove;
+   Move tableMove;
+};
+
+// Iterative deepening alpha-beta search, driven by continueSearch().
+struct Search {
+   Board board;
+   // The game so far plus the moves being searched, for spotting repetitions
+   PositionHistory history;
+   SearchFrame frames[MAX_PLY];
+   // Shared by every search that uses it, NULL for none
+   TranspositionTable* table;
+   TableStats tableStats;
+   // Endgames known exactly, NULL for none
+   const TablebaseSet* tablebases;
+   u64 tablebaseHits;
+   // [ply], quiet moves that caused a cutoff, tried right after captures
+   Move killers[MAX_PLY][2];
+   u8 ply;
+   // Limits, 0 for none
+   u8 maxDepth;
+   u64 maxNodes;
+   // Iteration being searched
+   u8 depth;
+   u64 nodes;
+   // Best move of the deepest iteration. The current iteration replaces it as soon as it finds a better
+   // score, which it can trust because the previous best move is always searched first.
+   Move bestMove;
+   s16 score;
+   u8 completedDepth;
+   bool finished;
+};
+
+inline bool isCapture(const Board &board, Move move) {
+   return pieceOn(board, moveTo(move)) || moveFlag(move) == MOVE_EN_PASSANT;
+}
+
+// Mate scores count plies from the root, but a table entry can be reached from another ply, so they're stored
+// as plies from the position itself.
+inline s16 scoreToTable(s16 score, u8 ply) {
+   if (score >= MATE_BOUND) {
+      return score + ply;
+   }
+   if (score <= -MATE_BOUND) {
+      return score - ply;
+   }
+   return score;
+}
+
+inline s16 scoreFromTable(s16 score, u8 ply) {
+   if (score >= MATE_BOUND) {
+      return score - ply;
+   }
+   if (score <= -MATE_BOUND) {
+      return score + ply;
+   }
+   return score;
+}
+
+// The table's move or the previous iteration's best move first, then captures by most valuable victim and
+// least valuable attacker, queen promotions, killers, and the rest.
+void scoreMoves(Search &search, SearchFrame &frame) {
+   const Board &board = search.board;
+   bool tableMoveFound = false;
+   for (u16 i = 0; i < frame.moves.size; i++) {
+      Move move = frame.moves.moves[i];
+      s16 score = 0;
+      if (move == frame.tableMove) {
+         score = 30000;
+         tableMoveFound = true;
+      }
+      else if (search.ply == 0 && move == search.bestMove) {
+         score = 29000;
+      }
+      else if (isCapture(board, move)) {
+         Piece victim = (moveFlag(move) == MOVE_EN_PASSANT) ? pawn : pieceOn(board, moveTo(move));
+         score = 20000 + PIECE_VALUES[victim] - PIECE_VALUES[pieceOn(board, moveFrom(move))] / 10;
+      }
+      else if (movePromotion(move) == queen) {
+         score = 19000;
+      }
+      else if (move == search.killers[search.ply][0]) {
+         score = 15000;
+      }
+      else if (move == search.killers[search.ply][1]) {
+         score = 14000;
+      }
+      frame.scores[i] = score;
+   }
+   if (frame.tableMove && !tableMoveFound) {
+      search.tableStats.collisions++;
+   }
+}
+
+void startIteration(Search &search, u8 depth) {
+   SearchFrame &root = search.frames[0];
+   search.depth = depth;
+   search.ply = 0;
+   root.alpha = -INFINITE_SCORE;
+   root.beta = INFINITE_SCORE;
+   root.depth = depth;
+   root.state = FRAME_ENTER;
+}
+
+// Sets up a search of the position. maxDepth and maxNodes of 0 mean no limit; the search then runs until
+// stopSearch() is called. The caller starts a new table generation, since several searches can share one.
+void startSearch(Search &search, const Board &board, const PositionHistory &history, u8 maxDepth, u64 maxNodes) {
+   search.board = board;
+   search.history = history;
+   memset(search.killers, 0, sizeof(search.killers));
+   search.maxDepth = (maxDepth && maxDepth < MAX_PLY) ? maxDepth : MAX_PLY - 1;
+   search.maxNodes = maxNodes;
+   search.nodes = 0;
+   search.bestMove = MOVE_NONE;
+   search.score = 0;
+   search.completedDepth = 0;
+   search.finished = false;
+   memset(&search.tableStats, 0, sizeof(search.tableStats));
+   search.tablebaseHits = 0;
+   startIteration(search, 1);
+}
+
+inline void stopSearch(Search &search) {
+   search.finished = true;
+}
+
+void finishIteration(Search &search, s16 score) {
+   search.completedDepth = search.depth;
+   search.score = score;
+   // Nothing to play, the limit is reached, or a mate was found that deeper searches can't improve on.
+   if (!search.bestMove || search.depth >= search.maxDepth || score >= MATE_BOUND || score <= -MATE_BOUND) {
+      search.finished = true;
+      return;
+   }
+   startIteration(search, search.depth + 1);
+}
+
+// Hands the score of the node at the current ply back to the ply below.
+void returnScore(Search &search, s16 score) {
+   if (search.ply == 0) {
+      finishIteration(search, score);
+      return;
+   }
+   search.ply--;
+   SearchFrame &frame = search.frames[search.ply];
+   unmakeMove(search.board, frame.move, frame.undo);
+   search.history.size--;
+
+   score = -score;
+   if (score <= frame.best) {
+      return;
+   }
+   frame.best = score;
+   if (score <= frame.alpha) {
+      return;
+   }
+   frame.alpha = score;
+   frame.bestMove = frame.move;
+   if (search.ply == 0) {
+      search.bestMove = frame.move;
+      search.score = score;
+   }
+   if (score >= frame.beta) {
+      Move (&killers)[2] = search.killers[search.ply];
+      if (!isCapture(search.board, frame.move) && !movePromotion(frame.move) && killers[0] != frame.move) {
+         killers[1] = killers[0];
+         killers[0] = frame.move;
+      }
+      // Cutoff, the other moves don't need searching.
+      frame.next = frame.moves.size;
+   }
+}
+
+void enterNode(Search &search) {
+   Board &board = search.board;
+   SearchFrame &frame = search.frames[search.ply];
+
+   if (search.ply > 0 && (board.halfmoveClock >= 100 || repetitions(search.history, board))) {
+      returnScore(search, 0);
+      return;
+   }
+   if (search.ply == MAX_PLY - 1) {
+      returnScore(search, evaluate(board));
+      return;
+   }
+
+   // Endgames in the tablebases need no searching, except at the root, which has to come up with a move. Tables
+   // read from a file are only probed right after a capture or pawn move, where the material or the pawns just
+   // changed: that's how the search gets into them, and a file read at every node costs more than it saves.
+   TablebaseOutcome outcome;
+   u8 plies;
+   if (search.tablebases && search.ply > 0 && probeTablebase(*search.tablebases, board, outcome, plies, board.halfmoveClock != 0)) {
+      search.tablebaseHits++;
+      returnScore(search, (outcome == TABLEBASE_WIN) ? MATE_SCORE - search.ply - plies
+         : (outcome == TABLEBASE_LOSS) ? -MATE_SCORE + search.ply + plies : 0);
+      return;
+   }
+
+   frame.bestMove = MOVE_NONE;
+   frame.tableMove = MOVE_NONE;
+   if (search.table && frame.depth > 0) {
+      TableEntry entry;
+      if (probeTable(*search.table, board.key, entry, search.tableStats)) {
+         frame.tableMove = entry.move;
+         s16 score = scoreFromTable(entry.score, search.ply);
+         Bound bound = entryBound(entry);
+         // Good enough to use as the score, except at the root, which has to come up with a move.
+         if (search.ply > 0 && entry.depth >= frame.depth && (bound == BOUND_EXACT
+            || (bound == BOUND_LOWER && score >= frame.beta) || (bound == BOUND_UPPER && score <= frame.alpha))) {
+            returnScore(search, score);
+            return;
+         }
+      }
+   }
+
+   Legality legality;
+   calculateLegality(board, board.turn, legality);
+   clearMoves(frame.moves);
+   Bitboard pieces = board.colors[board.turn];
+   while (pieces) {
+      calculateLegalPieceMoves(board, legality, popLowestSquare(pieces), frame.moves);
+   }
+
+   frame.best = -INFINITE_SCORE;
+   if (frame.depth <= 0 && !legality.checkers) {
+      // Quiescence. Standing pat is allowed, so only moves that could change the material are searched.
+      s16 standPat = evaluate(board);
+      if (standPat >= frame.beta) {
+         returnScore(search, standPat);
+         return;
+      }
+      if (standPat > frame.alpha) {
+         frame.alpha = standPat;
+      }
+      frame.best = standPat;
+      u16 kept = 0;
+      for (u16 i = 0; i < frame.moves.size; i++) {
+         if (isCapture(board, frame.moves.moves[i]) || movePromotion(frame.moves.moves[i]) == queen) {
+            frame.moves.moves[kept++] = frame.moves.moves[i];
+         }
+      }
+      frame.moves.size = kept;
+   }
+   else if (!frame.moves.size) {
+      returnScore(search, legality.checkers ? -MATE_SCORE + search.ply : 0);
+      return;
+   }
+
+   scoreMoves(search, frame);
+   frame.next = 0;
+   frame.state = FRAME_NEXT;
+}
+
+// Searches the best-ordered move left at the current ply, or returns the ply's score if none are left.
+void nextMove(Search &search) {
+   SearchFrame &frame = search.frames[search.ply];
+   if (frame.next >= frame.moves.size) {
+      if (search.table && frame.depth > 0) {
+         Bound bound = (frame.best >= frame.beta) ? BOUND_LOWER : (frame.bestMove) ? BOUND_EXACT : BOUND_UPPER;
+         storeTable(*search.table, search.board.key, frame.bestMove, scoreToTable(frame.best, search.ply), frame.depth, bound,
+            search.tableStats);
+      }
+      returnScore(search, frame.best);
+      return;
+   }
+
+   u16 pick = frame.next;
+   for (u16 i = frame.next + 1; i < frame.moves.size; i++) {
+      if (frame.scores[i] > frame.scores[pick]) {
+         pick = i;
+      }
+   }
+   Move move = frame.moves.moves[pick];
+   frame.moves.moves[pick] = frame.moves.moves[frame.next];
+   frame.scores[pick] = frame.scores[frame.next];
+   frame.next++;
+
+   frame.move = move;
+   makeMove(search.board, move, frame.undo);
+   pushPosition(search.history, search.board.key);
+
+   SearchFrame &child = search.frames[++search.ply];
+   child.alpha = -frame.beta;
+   child.beta = -frame.alpha;
+   child.depth = frame.depth - 1;
+   child.state = FRAME_ENTER;
+}
+
+// Searches at most the given number of nodes. Returns early when an iteration completes, so completedDepth
+// can be reported. Returns true once the search is over.
+bool continueSearch(Search &search, u32 nodes) {
+   u8 completedDepth = search.completedDepth;
+   while (!search.finished && search.completedDepth == completedDepth) {
+      SearchFrame &frame = search.frames[search.ply];
+      if (frame.state == FRAME_ENTER) {
+         if (!nodes || (search.maxNodes && search.nodes >= search.maxNodes)) {
+            search.finished = search.maxNodes && search.nodes >= search.maxNodes;
+            break;
+         }
+         nodes--;
+         search.nodes++;
+         enterNode(search);
+      }
+      else {
+         nextMove(search);
+      }
+   }
+   return search.finished;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include "board.h"
+
+// What a stored score says about the real one
+enum Bound : u8 { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+struct TableEntry {
+   // Top 16 bits of the key. The bottom bits already picked the bucket.
+   u16 check;
+   Move move;
+   s16 score;
+   s8 depth;
+   // Bound in bits 0-1, the generation of the search that stored it in bits 2-7
+   u8 flags;
+};
+
+#define TABLE_BUCKET_SIZE 4
+
+// Entries are packed into 64 bits (check, move, score, depth, flags from the low bits up) and always read and
+// written whole with atomic operations. Searches on several threads can then share the table without locks:
+// an entry can be overwritten between two reads, but never seen half written. A bucket is 32 bytes, so two
+// of them fill a cache line.
+struct TableBucket {
+   u64 entries[TABLE_BUCKET_SIZE];
+};
+
+// Results of earlier searches, keyed by Zobrist key. The size is fixed by initTable(), which is meant to be
+// called once at startup, since the memory can't be moved around while searches use it.
+struct TranspositionTable {
+   TableBucket* buckets;
+   // Power of two
+   u64 bucketCount;
+   u8 generation;
+};
+
+// Kept by each search rather than the table, so threads sharing the table don't fight over the counters.
+struct TableStats {
+   u64 probes;
+   u64 hits;
+   // Hits on an entry that was really for another position with the same check bits, as noticed by the search
+   // when the stored move isn't legal
+   u64 collisions;
+   u64 stores;
+   // Stores that pushed out another position's entry
+   u64 replacements;
+};
+
+inline void addTableStats(TableStats &total, const TableStats &stats) {
+   total.probes += stats.probes;
+   total.hits += stats.hits;
+   total.collisions += stats.collisions;
+   total.stores += stats.stores;
+   total.replacements += stats.replacements;
+}
+
+inline TableEntry unpackEntry(u64 bits) {
+   TableEntry entry;
+   entry.check = bits;
+   entry.move = bits >> 16;
+   entry.score = bits >> 32;
+   entry.depth = bits >> 48;
+   entry.flags = bits >> 56;
+   return entry;
+}
+
+inline u64 packEntry(const TableEntry &entry) {
+   return entry.check | ((u64)entry.move << 16) | ((u64)(u16)entry.score << 32) | ((u64)(u8)entry.depth << 48)
+      | ((u64)entry.flags << 56);
+}
+
+inline TableEntry loadEntry(const u64 &slot) {
+   return unpackEntry(__atomic_load_n(&slot, __ATOMIC_RELAXED));
+}
+
+inline void saveEntry(u64 &slot, const TableEntry &entry) {
+   __atomic_store_n(&slot, packEntry(entry), __ATOMIC_RELAXED);
+}
+
+// Allocates the largest power of two number of buckets that fits in the budget. Returns false if the memory
+// isn't there.
+bool initTable(TranspositionTable &table, u32 megabytes) {
+   u64 bytes = (u64)megabytes << 20;
+   table.bucketCount = 1;
+   while (table.bucketCount * 2 * sizeof(TableBucket) <= bytes) {
+      table.bucketCount *= 2;
+   }
+   table.buckets = (TableBucket*)calloc(table.bucketCount, sizeof(TableBucket));
+   table.generation = 0;
+   return table.buckets != NULL;
+}
+
+void freeTable(TranspositionTable &table) {
+   free(table.buckets);
+   table.buckets = NULL;
+}
+
+// Forgets every entry. Only while no search is using the table.
+inline void clearTable(TranspositionTable &table) {
+   memset(table.buckets, 0, table.bucketCount * sizeof(TableBucket));
+}
+
+inline u64 tableBytes(const TranspositionTable &table) {
+   return table.bucketCount * sizeof(TableBucket);
+}
+
+// Called at the start of every search, so entries from earlier ones are replaced first.
+inline void newTableGeneration(TranspositionTable &table) {
+   table.generation = (table.generation + 1) & 63;
+}
+
+inline Bound entryBound(const TableEntry &entry) {
+   return (Bound)(entry.flags & 3);
+}
+
+// Copies the position's entry and returns true if there is one.
+bool probeTable(const TranspositionTable &table, u64 key, TableEntry &entry, TableStats &stats) {
+   stats.probes++;
+   const TableBucket &bucket = table.buckets[key & (table.bucketCount - 1)];
+   u16 check = key >> 48;
+   for (u8 i = 0; i < TABLE_BUCKET_SIZE; i++) {
+      entry = loadEntry(bucket.entries[i]);
+      if (entryBound(entry) && entry.check == check) {
+         stats.hits++;
+         return true;
+      }
+   }
+   return false;
+}
+
+// Stores over the position's own entry if it has one, otherwise over an empty one, otherwise over the one
+// worth least: the oldest, and among those the shallowest.
+void storeTable(TranspositionTable &table, u64 key, Move move, s16 score, s8 depth, Bound bound, TableStats &stats) {
+   TableBucket &bucket = table.buckets[key & (table.bucketCount - 1)];
+   u16 check = key >> 48;
+   u8 replace = 0;
+   TableEntry old = unpackEntry(0);
+   s16 replaceWorth = 0;
+   for (u8 i = 0; i < TABLE_BUCKET_SIZE; i++) {
+      TableEntry entry = loadEntry(bucket.entries[i]);
+      if (!entryBound(entry) || entry.check == check) {
+         replace = i;
+         old = entry;
+         break;
+      }
+      s16 worth = entry.depth - 8 * ((table.generation - (entry.flags >> 2)) & 63);
+      if (!i || worth < replaceWorth) {
+         replace = i;
+         old = entry;
+         replaceWorth = worth;
+      }
+   }
+
+   stats.stores++;
+   bool samePosition = entryBound(old) && old.check == check;
+   if (entryBound(old) && !samePosition) {
+      stats.replacements++;
+   }
+   TableEntry entry;
+   entry.check = check;
+   // A fail-low has no best move, but an earlier search of the position might.
+   entry.move = (move || !samePosition) ? move : old.move;
+   entry.score = score;
+   entry.depth = depth;
+   entry.flags = bound | (table.generation << 2);
+   saveEntry(bucket.entries[replace], entry);
+}
+
+// Per mille of the entries that belong to the current generation, from a sample of the first buckets.
+u16 tableFill(const TranspositionTable &table) {
+   u64 sample = (table.bucketCount < 250) ? table.bucketCount : 250;
+   u64 used = 0;
+   for (u64 b = 0; b < sample; b++) {
+      for (u8 i = 0; i < TABLE_BUCKET_SIZE; i++) {
+         TableEntry entry = loadEntry(table.buckets[b].entries[i]);
+         used += entryBound(entry) && (entry.flags >> 2) == table.generation;
+      }
+   }
+   return used * 1000 / (sample * TABLE_BUCKET_SIZE);
+}
@@ -0,0 +1,470 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "movegen.h"
+
+#ifndef _3DS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Endgame tablebases: the distance to mate of every position with a few pieces, worked out ahead of time by
+// the host's tablebase tool. A table covers one material set, named by its pieces with the stronger side
+// first (KQK, KRKP, KBNK). A position is looked up with the stronger side as white, mirrored if it isn't, and
+// turned so the stronger king is in a1-d1-d4 (a-d if there are pawns), so a table only needs a byte for each
+// of those positions.
+
+// Pieces besides the kings
+#define TABLEBASE_MAX_EXTRA 2
+#define TABLEBASE_MAX_PIECES (2 + TABLEBASE_MAX_EXTRA)
+// Every table of up to four pieces
+#define MAX_TABLEBASES 35
+
+// Table file: "C3TB", the number of positions, the name padded to 8 bytes, then a byte for each position.
+#define TABLEBASE_MAGIC 0x42543343
+#define TABLEBASE_HEADER_SIZE 16
+
+#ifdef _3DS
+// Tables up to this size are read into memory when they're opened: every three piece table, 80 KB each and
+// 256 KB for KPK. The four piece ones, 5 MB and up, stay in their files.
+#define TABLEBASE_MEMORY_BYTES 0x40000
+#define TABLEBASE_FILE_BUFFER 0x1000
+#endif
+
+// Stored values are the plies to mate plus one, so they're odd when the side to move gets mated and even when
+// it mates. Draws are 0. Positions that can't come up, and those that are looked up as a mirror of another,
+// are TABLEBASE_INVALID.
+const u8 TABLEBASE_DRAW = 0;
+const u8 TABLEBASE_INVALID = 255;
+
+enum TablebaseOutcome : u8 { TABLEBASE_DRAWN, TABLEBASE_WIN, TABLEBASE_LOSS };
+
+// Strongest first, the order pieces are listed in
+const Piece TABLEBASE_ORDER[] = { queen, rook, bishop, knight, pawn };
+const char TABLEBASE_LETTERS[] = " KQRNBP";
+
+struct TablebaseMaterial {
+   // [side], pieces besides the king in TABLEBASE_ORDER. Side 0 is the stronger one.
+   Piece pieces[2][TABLEBASE_MAX_EXTRA];
+   u8 counts[2];
+};
+
+struct Tablebase {
+   TablebaseMaterial material;
+   bool pawns;
+   u32 size;
+#ifdef _3DS
+   // The values of a table in memory, NULL for one read from its file
+   u8* values;
+   FILE* file;
+#else
+   const u8* values;
+   // Of the whole mapped file, 0 if the values aren't mapped
+   size_t mappedBytes;
+#endif
+};
+
+struct TablebaseSet {
+   Tablebase tables[MAX_TABLEBASES];
+   u8 count;
+};
+
+inline u8 tablebaseOrder(Piece piece) {
+   u8 order = 0;
+   while (TABLEBASE_ORDER[order] != piece) {
+      order++;
+   }
+   return order;
+}
+
+// Strongest first: more pieces, then the stronger pieces.
+bool strongerMaterial(const Piece* a, u8 aCount, const Piece* b, u8 bCount) {
+   if (aCount != bCount) {
+      return aCount > bCount;
+   }
+   for (u8 i = 0; i < aCount; i++) {
+      if (a[i] != b[i]) {
+         return tablebaseOrder(a[i]) < tablebaseOrder(b[i]);
+      }
+   }
+   return false;
+}
+
+inline bool sameMaterial(const Piece* a, u8 aCount, const Piece* b, u8 bCount) {
+   return aCount == bCount && !memcmp(a, b, aCount * sizeof(Piece));
+}
+
+// Collects a color's pieces besides the king in TABLEBASE_ORDER. Returns false if there are too many.
+bool colorMaterial(const Board &board, Color color, Piece (&pieces)[TABLEBASE_MAX_EXTRA], u8 &count) {
+   count = 0;
+   for (u8 i = 0; i < 5; i++) {
+      Piece piece = TABLEBASE_ORDER[i];
+      for (u8 n = popCount(board.pieces[color][piece]); n; n--) {
+         if (count == TABLEBASE_MAX_EXTRA) {
+            return false;
+         }
+         pieces[count++] = piece;
+      }
+   }
+   return true;
+}
+
+// Reads a name like KRKP. Returns false if it isn't one.
+bool parseTablebaseName(const char* name, TablebaseMaterial &material) {
+   memset(&material, 0, sizeof(material));
+   s8 side = -1;
+   for (; *name; name++) {
+      if (*name == 'K') {
+         if (++side > 1) {
+            return false;
+         }
+         continue;
+      }
+      const char* letter = strchr(TABLEBASE_LETTERS + 2, *name);
+      if (side < 0 || !letter || material.counts[0] + material.counts[1] == TABLEBASE_MAX_EXTRA) {
+         return false;
+      }
+      material.pieces[side][material.counts[side]++] = (Piece)(letter - TABLEBASE_LETTERS);
+   }
+   // Has to be written the way it's looked up, strongest side and pieces first.
+   for (u8 s = 0; s < 2; s++) {
+      if (material.counts[s] == 2 && tablebaseOrder(material.pieces[s][0]) > tablebaseOrder(material.pieces[s][1])) {
+         return false;
+      }
+   }
+   return side == 1 && material.counts[0] + material.counts[1] > 0
+      && !strongerMaterial(material.pieces[1], material.counts[1], material.pieces[0], material.counts[0]);
+}
+
+char* tablebaseName(const TablebaseMaterial &material, char (&name)[8]) {
+   u8 length = 0;
+   for (u8 s = 0; s < 2; s++) {
+      name[length++] = 'K';
+      for (u8 i = 0; i < material.counts[s]; i++) {
+         name[length++] = TABLEBASE_LETTERS[material.pieces[s][i]];
+      }
+   }
+   name[length] = '\0';
+   return name;
+}
+
+// Where the stronger king can be, or -1 if that square is looked up through a mirror
+inline s8 tablebaseKingClass(u8 square, bool pawns) {
+   u8 row = square / 8;
+   u8 column = square % 8;
+   if (pawns) {
+      return (column < 4) ? row * 4 + column : -1;
+   }
+   if (column > 3 || row > column) {
+      return -1;
+   }
+   return row * 4 + column - row * (row + 1) / 2;
+}
+
+inline u8 tablebaseKingClasses(bool pawns) {
+   return pawns ? 32 : 10;
+}
+
+// Bit 0 mirrors the columns, bit 1 the rows, bit 2 swaps rows and columns.
+inline u8 transformSquare(u8 square, u8 symmetry) {
+   if (symmetry & 1) {
+      square ^= 7;
+   }
+   if (symmetry & 2) {
+      square ^= 56;
+   }
+   if (symmetry & 4) {
+      square = ((square & 7) << 3) | (square >> 3);
+   }
+   return square;
+}
+
+u32 tablebaseSize(const TablebaseMaterial &material, bool pawns) {
+   u32 size = 2 * tablebaseKingClasses(pawns) * 64;
+   for (u8 i = 0; i < material.counts[0] + material.counts[1]; i++) {
+      size *= 64;
+   }
+   return size;
+}
+
+// Index of the position given by its squares: the stronger king, the other king, then the pieces in the
+// table's order. Of the mirrors that put the stronger king where it can be, the one with the lowest index is
+// used, so every position has just one.
+u32 tablebaseIndex(const Tablebase &tablebase, const u8* squares, u8 turn) {
+   const TablebaseMaterial &material = tablebase.material;
+   u8 count = 2 + material.counts[0] + material.counts[1];
+   u32 best = 0xFFFFFFFF;
+   for (u8 symmetry = 0; symmetry < (tablebase.pawns ? 2 : 8); symmetry++) {
+      s8 kingClass = tablebaseKingClass(transformSquare(squares[0], symmetry), tablebase.pawns);
+      if (kingClass < 0) {
+         continue;
+      }
+      u8 turned[TABLEBASE_MAX_PIECES] = { 0 };
+      for (u8 i = 1; i < count; i++) {
+         turned[i] = transformSquare(squares[i], symmetry);
+      }
+      // Two of the same piece can be either way round, so they're put in order.
+      for (u8 s = 0, first = 2; s < 2; first += material.counts[s], s++) {
+         if (material.counts[s] == 2 && material.pieces[s][0] == material.pieces[s][1] && turned[first] > turned[first + 1]) {
+            u8 square = turned[first];
+            turned[first] = turned[first + 1];
+            turned[first + 1] = square;
+         }
+      }
+      u32 index = turn * tablebaseKingClasses(tablebase.pawns) + kingClass;
+      for (u8 i = 1; i < count; i++) {
+         index = index * 64 + turned[i];
+      }
+      if (index < best) {
+         best = index;
+      }
+   }
+   return best;
+}
+
+// Finds the table for the board's material and whether black is its stronger side. Returns NULL if there isn't
+// one loaded.
+const Tablebase* findTablebase(const TablebaseSet &set, const Board &board, bool &swap) {
+   Piece pieces[2][TABLEBASE_MAX_EXTRA];
+   u8 counts[2];
+   if (!colorMaterial(board, white, pieces[white], counts[white]) || !colorMaterial(board, black, pieces[black], counts[black])) {
+      return NULL;
+   }
+   swap = strongerMaterial(pieces[black], counts[black], pieces[white], counts[white]);
+   for (u8 i = 0; i < set.count; i++) {
+      const TablebaseMaterial &material = set.tables[i].material;
+      if (sameMaterial(material.pieces[0], material.counts[0], pieces[swap], counts[swap])
+         && sameMaterial(material.pieces[1], material.counts[1], pieces[!swap], counts[!swap])) {
+         return &set.tables[i];
+      }
+   }
+   return NULL;
+}
+
+// Index of the board in its table, found by findTablebase().
+u32 boardTablebaseIndex(const Tablebase &tablebase, const Board &board, bool swap) {
+   u8 squares[TABLEBASE_MAX_PIECES];
+   u8 count = 0;
+   u8 mirror = swap ? 56 : 0;
+   squares[count++] = kingSquare(board, (Color)swap) ^ mirror;
+   squares[count++] = kingSquare(board, (Color)!swap) ^ mirror;
+   for (u8 s = 0; s < 2; s++) {
+      Color color = (Color)(s ^ swap);
+      Piece last = none;
+      Bitboard left = 0;
+      for (u8 i = 0; i < tablebase.material.counts[s]; i++) {
+         Piece piece = tablebase.material.pieces[s][i];
+         if (piece != last) {
+            left = board.pieces[color][piece];
+            last = piece;
+         }
+         squares[count++] = popLowestSquare(left) ^ mirror;
+      }
+   }
+   return tablebaseIndex(tablebase, squares, board.turn ^ swap);
+}
+
+// Whether a probe is only a memory read, as it always is on the host. Otherwise it's a file read.
+inline bool tablebaseInMemory(const Tablebase &tablebase) {
+   return tablebase.values;
+}
+
+inline u8 tablebaseValue(const Tablebase &tablebase, u32 index) {
+#ifdef _3DS
+   if (tablebase.values) {
+      return tablebase.values[index];
+   }
+   if (fseek(tablebase.file, TABLEBASE_HEADER_SIZE + (long)index, SEEK_SET) != 0) {
+      return TABLEBASE_INVALID;
+   }
+   int value = fgetc(tablebase.file);
+   return (value == EOF) ? TABLEBASE_INVALID : value;
+#else
+   return __atomic_load_n(&tablebase.values[index], __ATOMIC_RELAXED);
+#endif
+}
+
+inline TablebaseOutcome valueOutcome(u8 value) {
+   return (value == TABLEBASE_DRAW) ? TABLEBASE_DRAWN : (value & 1) ? TABLEBASE_LOSS : TABLEBASE_WIN;
+}
+
+// Looks the position up for the side to move. Returns false if no table has it, or it can castle or take en
+// passant, which the tables leave out, or memoryOnly is set and its table is read from a file. Otherwise plies
+// is the number of plies to mate, unless it's a draw.
+bool probeTablebase(const TablebaseSet &set, const Board &board, TablebaseOutcome &outcome, u8 &plies, bool memoryOnly = false) {
+   if (!set.count || board.castling || board.enPassant >= 0 || popCount(board.occupied) > TABLEBASE_MAX_PIECES) {
+      return false;
+   }
+   outcome = TABLEBASE_DRAWN;
+   plies = 0;
+   // Two kings
+   if (popCount(board.occupied) == 2) {
+      return true;
+   }
+   bool swap;
+   const Tablebase* tablebase = findTablebase(set, board, swap);
+   if (!tablebase || (memoryOnly && !tablebaseInMemory(*tablebase))) {
+      return false;
+   }
+   u8 value = tablebaseValue(*tablebase, boardTablebaseIndex(*tablebase, board, swap));
+   if (value == TABLEBASE_INVALID) {
+      return false;
+   }
+   outcome = valueOutcome(value);
+   plies = value ? value - 1 : 0;
+   return true;
+}
+
+inline void encodeTablebaseHeader(const Tablebase &tablebase, u8 (&bytes)[TABLEBASE_HEADER_SIZE]) {
+   char name[8];
+   memset(bytes, 0, sizeof(bytes));
+   for (u8 i = 0; i < 4; i++) {
+      bytes[i] = TABLEBASE_MAGIC >> (8 * i);
+      bytes[4 + i] = tablebase.size >> (8 * i);
+   }
+   tablebaseName(tablebase.material, name);
+   memcpy(bytes + 8, name, strlen(name));
+}
+
+inline bool checkTablebaseHeader(const Tablebase &tablebase, const u8* bytes, u64 fileSize) {
+   u8 expected[TABLEBASE_HEADER_SIZE];
+   encodeTablebaseHeader(tablebase, expected);
+   return fileSize == TABLEBASE_HEADER_SIZE + (u64)tablebase.size && !memcmp(bytes, expected, TABLEBASE_HEADER_SIZE);
+}
+
+// Opens the table file. Like the opening book, it's read in place: mapped on the host. On the 3DS the small
+// tables are read into memory and the rest are read a byte at a time.
+bool openTablebase(Tablebase &tablebase, const char* path) {
+#ifdef _3DS
+   tablebase.values = NULL;
+   tablebase.file = fopen(path, "rb");
+   if (!tablebase.file) {
+      return false;
+   }
+   u8 header[TABLEBASE_HEADER_SIZE];
+   fseek(tablebase.file, 0, SEEK_END);
+   long size = ftell(tablebase.file);
+   fseek(tablebase.file, 0, SEEK_SET);
+   if (size <= 0 || fread(header, TABLEBASE_HEADER_SIZE, 1, tablebase.file) != 1 || !checkTablebaseHeader(tablebase, header, size)) {
+      fclose(tablebase.file);
+      tablebase.file = NULL;
+      return false;
+   }
+   if (tablebase.size <= TABLEBASE_MEMORY_BYTES) {
+      tablebase.values = (u8*)malloc(tablebase.size);
+      bool read = tablebase.values && fread(tablebase.values, tablebase.size, 1, tablebase.file) == 1;
+      fclose(tablebase.file);
+      tablebase.file = NULL;
+      if (!read) {
+         free(tablebase.values);
+         tablebase.values = NULL;
+         return false;
+      }
+      return true;
+   }
+   // Probes of the positions after a move are mostly close together in the file, so a buffer read once
+   // serves several of them, and a seek within it is free.
+   setvbuf(tablebase.file, NULL, _IOFBF, TABLEBASE_FILE_BUFFER);
+#else
+   tablebase.values = NULL;
+   tablebase.mappedBytes = 0;
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      return false;
+   }
+   struct stat status;
+   void* data = (fstat(fd, &status) == 0 && status.st_size > 0) ? mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+   close(fd);
+   if (data == MAP_FAILED) {
+      return false;
+   }
+   if (!checkTablebaseHeader(tablebase, (const u8*)data, status.st_size)) {
+      munmap(data, status.st_size);
+      return false;
+   }
+   tablebase.values = (const u8*)data + TABLEBASE_HEADER_SIZE;
+   tablebase.mappedBytes = status.st_size;
+#endif
+   return true;
+}
+
+void closeTablebase(Tablebase &tablebase) {
+#ifdef _3DS
+   free(tablebase.values);
+   tablebase.values = NULL;
+   if (tablebase.file) {
+      fclose(tablebase.file);
+      tablebase.file = NULL;
+   }
+#else
+   if (tablebase.mappedBytes) {
+      munmap((void*)(tablebase.values - TABLEBASE_HEADER_SIZE), tablebase.mappedBytes);
+      tablebase.mappedBytes = 0;
+   }
+   tablebase.values = NULL;
+#endif
+}
+
+// Fills in the table's material and size from its name, without opening anything.
+bool initTablebase(Tablebase &tablebase, const char* name) {
+   memset(&tablebase, 0, sizeof(tablebase));
+   if (!parseTablebaseName(name, tablebase.material)) {
+      return false;
+   }
+   const TablebaseMaterial &material = tablebase.material;
+   for (u8 s = 0; s < 2; s++) {
+      for (u8 i = 0; i < material.counts[s]; i++) {
+         tablebase.pawns |= material.pieces[s][i] == pawn;
+      }
+   }
+   tablebase.size = tablebaseSize(material, tablebase.pawns);
+   return true;
+}
+
+// Opens every table in the directory, named like KQK.tb. Returns how many there were.
+u8 loadTablebases(TablebaseSet &set, const char* directory) {
+   set.count = 0;
+   // Every name of up to four pieces: the stronger side's pieces, then the other side's
+   for (u8 a = 0; a <= 5; a++) {
+      for (u8 b = a; b <= 5; b++) {
+         for (u8 c = 0; c <= 5; c++) {
+            char name[8];
+            u8 length = 0;
+            name[length++] = 'K';
+            if (a < 5) {
+               name[length++] = TABLEBASE_LETTERS[TABLEBASE_ORDER[a]];
+            }
+            if (b < 5) {
+               name[length++] = TABLEBASE_LETTERS[TABLEBASE_ORDER[b]];
+            }
+            name[length++] = 'K';
+            if (c < 5) {
+               name[length++] = TABLEBASE_LETTERS[TABLEBASE_ORDER[c]];
+            }
+            name[length] = '\0';
+
+            if (set.count >= MAX_TABLEBASES) {
+               return set.count;
+            }
+            Tablebase &tablebase = set.tables[set.count];
+            char path[256];
+            snprintf(path, sizeof(path), "%s/%s.tb", directory, name);
+            if (initTablebase(tablebase, name) && openTablebase(tablebase, path)) {
+               set.count++;
+            }
+         }
+      }
+   }
+   return set.count;
+}
+
+void closeTablebases(TablebaseSet &set) {
+   for (u8 i = 0; i < set.count; i++) {
+      closeTablebase(set.tables[i]);
+   }
+   set.count = 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// The rules engine only needs fixed-size integers and memset/memcpy, so it builds on the 3DS and on a plain host.
+#ifdef _3DS
+#include <3ds.h>
+#else
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+#endif
+
+#include <string.h>
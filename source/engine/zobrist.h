@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+
+// Random numbers XORed together into a 64-bit key that identifies a position. Filled by initZobrist().
+// [color][piece][square], none is unused
+u64 zobristPieces[2][7][64];
+// [castling rights]
+u64 zobristCastling[16];
+// [column of the en passant square]
+u64 zobristEnPassant[8];
+// XORed in when black is to move
+u64 zobristBlackToMove;
+
+// SplitMix64, with a fixed seed so keys are the same on every run and every platform.
+inline u64 nextRandom(u64 &state) {
+   u64 z = (state += 0x9E3779B97F4A7C15ULL);
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+   return z ^ (z >> 31);
+}
+
+void initZobrist() {
+   u64 state = 0x3D5C4E55ULL;
+   for (u8 color = 0; color < 2; color++) {
+      for (u8 piece = 0; piece < 7; piece++) {
+         for (u8 square = 0; square < 64; square++) {
+            zobristPieces[color][piece][square] = nextRandom(state);
+         }
+      }
+   }
+   // No rights at all adds nothing, so a board without castling only differs in pieces.
+   zobristCastling[0] = 0;
+   for (u8 i = 1; i < 16; i++) {
+      zobristCastling[i] = nextRandom(state);
+   }
+   for (u8 i = 0; i < 8; i++) {
+      zobristEnPassant[i] = nextRandom(state);
+   }
+   zobristBlackToMove = nextRandom(state);
+}
@@ -12,12 +12,48 @@ void menuInput(u32 kDown) {
       consoleClear();
       networkInit();
    }
+   else if (kDown & KEY_UP) {
+      gamemode = single_player;
+      consoleClear();
+      // The player is white.
+      computerState.color = black;
+      computerState.montecarlo = false;
+   }
+   else if (kDown & KEY_L) {
+      gamemode = single_player;
+      consoleClear();
+      computerState.color = black;
+      computerState.montecarlo = true;
+   }
+   else if (kDown & KEY_DOWN) {
+      gamemode = system_multiplayer;
+      consoleClear();
+      if (!loadPosition(POSITION_PATH)) {
+         printf("Can't read a legal position from %s\n", POSITION_PATH);
+      }
+   }
 }
 
 void gameInput(u32 kDown) {
+   if (kDown & KEY_R) {
+      printf(saveGame(game, GAME_PATH) ? "Game saved to %s\n" : "Can't save to %s\n", GAME_PATH);
+   }
    if (gamemode == online_multiplayer) {
-      networkUpdate();
+      if (kDown & KEY_SELECT) {
+         computerState.ponder = !computerState.ponder;
+         printf("Background analysis %s.\n", computerState.ponder ? "on" : "off");
+      }
       if (!networkState.gameStarted || (networkState.systemColor != gameState.playerTurn)) {
+         if (networkState.gameStarted) {
+            ponderUpdate();
+         }
+         return;
+      }
+      ponderFinish();
+   }
+   else if (gamemode == single_player) {
+      computerUpdate();
+      if (gameState.playerTurn == computerState.color) {
          return;
       }
    }
@@ -42,9 +78,11 @@ void gameInput(u32 kDown) {
          replace = knight;
       }
       if (replace) {
-         chessBoard[gameState.selectedPiece.column][gameState.selectedPiece.row].currentPiece = replace;
-         movePiece(gameState.selectedPiece, gameState.promotedPawnMove);
-         netSendMove(gameState.selectedPiece, passIn, replace);
+         Move move = createMove(moveFrom(gameState.promotionMove), moveTo(gameState.promotionMove), MOVE_PROMOTION, replace);
+         playMove(move);
+         if (gamemode == online_multiplayer) {
+            netSendMove(move);
+         }
          gameState.pieceSelected = false;
          gameState.promotion = false;
       }
@@ -58,8 +96,10 @@ void gameInput(u32 kDown) {
                gameState.selectedPiece.column = (touch.px - 40) / 30;
                gameState.selectedPiece.row = 7 - touch.py / 30;
                // Make sure touched spot has a chess piece that the same color as current turn player
-               if (chessBoard[gameState.selectedPiece.column][gameState.selectedPiece.row].currentPiece && chessBoard[gameState.selectedPiece.column][gameState.selectedPiece.row].pieceColor == gameState.playerTurn) {
+               u8 square = squareOf(gameState.selectedPiece);
+               if (pieceOn(game.board, square) && colorOn(game.board, square) == gameState.playerTurn) {
                   gameState.pieceSelected = true;
+                  calculateSquareMoves(game, square);
                }
             }
             else {
@@ -74,9 +114,10 @@ void gameInput(u32 kDown) {
                else {
                   passIn.column = touchColumn;
                   passIn.row = touchRow;
-                  if (validMove(gameState.selectedPiece, passIn)) {
+                  Move move = validMove(game, gameState.selectedPiece, passIn);
+                  if (move) {
                      // Prompt for wanted piece if pawn is being promoted.
-                     if (chessBoard[gameState.selectedPiece.column][gameState.selectedPiece.row].currentPiece == pawn && (touchRow == 0 || touchRow == 7)) {
+                     if (moveFlag(move) == MOVE_PROMOTION) {
                         gameState.promotion = true;
                         printf("================================================\n");
                         printf("Press the following button to promote your pawn.\n");
@@ -85,12 +126,12 @@ void gameInput(u32 kDown) {
                         printf("X: Rook\n");
                         printf("Y: Knight\n");
                         printf("================================================\n");
-                        gameState.promotedPawnMove = passIn;
+                        gameState.promotionMove = move;
                      }
                      else {
-                        movePiece(gameState.selectedPiece, passIn);
+                        playMove(move);
                         if (gamemode == online_multiplayer) {
-                           netSendMove(gameState.selectedPiece, passIn, none);
+                           netSendMove(move);
                         }
                         gameState.pieceSelected = false;
                      }
@@ -5,6 +5,7 @@
 
 #include "game.h"
 #include "network.h"
+#include "computer.h"
 #include "input.h"
 #include "draw.h"
 
@@ -14,13 +15,17 @@ int main(int argc, char* argv[])
 	consoleInit(GFX_TOP, NULL);
 	
 	drawInit();
+	initBitboards();
+	initZobrist();
+	loadTablebases(tablebases, TABLEBASE_PATH);
+	computerInit();
 	setupBoard();
-	calculateAllMoves(white);
 
 	atexit(gfxExit);
 	atexit(drawFinish);
 
-	printf("Press left on the d-pad for single-system multiplayer. Press right for online multiplayer.\n");
+	printf("Press left on the d-pad for single-system multiplayer. Press right for online multiplayer. Press up to play against the computer, or L for the Monte Carlo computer. Press down to play on from the position in " POSITION_PATH ".\n");
+	printf("Press R during a game to save it to " GAME_PATH ".\n");
 
 	// Main Loop
 	while (aptMainLoop())
@@ -28,6 +33,11 @@ int main(int argc, char* argv[])
 		hidScanInput();
 		u32 kDown = hidKeysDown();
 
+		// What the network thread received since the last frame
+		if (gamemode == online_multiplayer) {
+			networkUpdate();
+		}
+
 		if (!gamemode) {
 			menuInput(kDown);
 		}
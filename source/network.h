@@ -20,6 +20,8 @@
 
 #include <3ds.h>
 
+#include "engine/netclient.h"
+
 #define CHESS_SERVER_ADDRESS "152.67.248.0"
 
 #define SOC_ALIGN       0x1000
@@ -30,11 +32,11 @@ static u32* SOC_buffer = NULL;
 __attribute__((format(printf, 1, 2)))
 void failExit(const char* fmt, ...);
 
-s32 sock = -1;
-u16 pingTimer = 0;
+// Connects, sends and receives on its own thread. The main loop takes what arrived each frame.
+NetClient netClient;
 
 void networkShutdown() {
-	if (sock > 0) { close(sock); }
+	stopNetClient(netClient);
 	socExit();
 }
 
@@ -57,143 +59,141 @@ void networkInit() {
 	// atexit functions execute in reverse order so this runs before gfxExit
 	atexit(networkShutdown);
 
-	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+	printf("Connecting to server. Wait 5 seconds.\n");
 
-	if (sock < 0) {
-		failExit("socket: %d %s\n", errno, strerror(errno));
+	if (!startNetClient(netClient, CHESS_SERVER_ADDRESS, PROTOCOL_PORT)) {
+		failExit("connect: %d %s\n", errno, strerror(errno));
 	}
+}
 
-	struct sockaddr_in server;
-	memset(&server, 0, sizeof(server));
-	server.sin_addr.s_addr = inet_addr(CHESS_SERVER_ADDRESS);
-	server.sin_family = AF_INET;
-	server.sin_port = htons(8000);
-
-	printf("Connecting to server. Wait 5 seconds.\n");
-
-	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+void printNetQueue(const char* name, const NetQueue &queue) {
+	printf("%s %lu messages, at most %lu queued, waited %llu us on average, %llu at most\n", name,
+		(unsigned long)queue.head, (unsigned long)queue.maxDepth,
+		(unsigned long long)(queue.head ? queue.waitTotal / queue.head : 0), (unsigned long long)queue.maxWait);
+}
 
-	if (connect(sock, (struct sockaddr*)&server, sizeof(struct sockaddr_in)) < 0) {
-		if ((errno != EWOULDBLOCK) && (errno != EINPROGRESS)) {
-			failExit("connect: %d %s\n", errno, strerror(errno));
-		}
-	}
+// Once the game is over. Stops the network thread, which makes its queue counters safe to read, and shows them.
+// The server closes the connection next, which is no longer an error.
+void networkFinish() {
+	stopNetClient(netClient);
+	printNetQueue("Received", netClient.inbound);
+	printNetQueue("Sent", netClient.outbound);
+	printf("Press start to exit.\n");
 }
 
-void networkUpdate() {
-	char recvBuffer[6];
-	int bytes;
-
-	pingTimer++;
-
-	// Timeout of 5 seconds for connect.
-	if (!networkState.connected) {
-		struct pollfd event;
-		event.fd = sock;
-		event.events = POLLOUT;
-			int ret = poll(&event, 1, 0);
-			if (ret > 0 && event.revents & POLLOUT) {
-				networkState.connected = true;
-				char byte = 0x3D;
-				if (send(sock, &byte, sizeof(char), 0) < 0) {
-					failExit("send: %d %s\n", errno, strerror(errno));
-				}
-
-				consoleClear();
-				printf("Connected, waiting for opponent.\n");
-			}
-		// Longer than 5 seconds
-		if (pingTimer > 300) {
-			failExit("timeout");
+void netHandleMessage(const u8* message, u8 length) {
+	switch (message[0]) {
+	case MESSAGE_GAME_START:
+		networkState.gameStarted = true;
+		networkState.systemColor = (Color)message[1];
+		// Ensure player doesn't try to move if turn packet is delayed
+		gameState.playerTurn = (Color)(!(bool)networkState.systemColor);
+
+		consoleClear();
+		printf("Game started. You are color %s.\n", ((bool)networkState.systemColor) ? "black" : "white");
+		printf("Press select to analyse while your opponent thinks.\n");
+
+		break;
+	case MESSAGE_TURN:
+		gameState.playerTurn = (Color)message[1];
+		break;
+	case MESSAGE_MOVE: {
+		// The server checks moves too, so one the rules don't allow means the two are out of step.
+		Move move = readMoveMessage(message, length, game.board);
+		if (!allowedMove(game, move)) {
+			failExit("Invalid message from the server.\n");
+			break;
 		}
-		return;
+		playMove(move);
+		break;
 	}
-
-	// Check if socket connection still up every 5 seconds
-	if (pingTimer > 300) {
-		pingTimer = 0;
-		char pingBuffer[6] = { 0x10, 0, 0, 0, 0, 0 };
-		if (send(sock, pingBuffer, 1, 0) < 0) {
-			failExit("send: %d %s\n", errno, strerror(errno));
+	case MESSAGE_GAME_OVER:
+		switch (message[1]) {
+		case GAME_OVER_ERROR:
+			// Error. Ideally shouldn't happen.
+			failExit("Game over: error.\n");
+			break;
+		case GAME_OVER_DRAW:
+			printf("Game over: draw.\n");
+			break;
+		case GAME_OVER_WIN:
+			printf("Game over: %s won.\n", ((bool)message[2]) ? "black" : "white");
+			break;
+		case GAME_OVER_ILLEGAL_MOVE:
+			// The server's board didn't allow the move.
+			printf("Game over: illegal move by %s.\n", ((bool)message[2]) ? "black" : "white");
+			break;
+		case GAME_OVER_VERSION:
+			failExit("Game over: the server speaks another protocol version. Update chess3DS.\n");
+			break;
 		}
+		networkFinish();
+		break;
 	}
+}
 
-	while ((bytes = recv(sock, recvBuffer, 6, 0)) == -1 && errno == EINTR);
-	if (bytes < 0) {
-		if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
-			failExit("recv: %d %s\n", errno, strerror(errno));
-		}
+void netHandleFailure(const NetEvent &event) {
+	switch (event.failure) {
+	case NET_FAILURE_TIMEOUT:
+		failExit("timeout");
+		break;
+	case NET_FAILURE_CLOSED:
+		failExit("The server closed the connection.\n");
+		break;
+	case NET_FAILURE_VERSION:
+		failExit("The server speaks another protocol version.\n");
+		break;
+	case NET_FAILURE_INVALID:
+		failExit("Invalid message from the server.\n");
+		break;
+	case NET_FAILURE_OVERFLOW:
+		failExit("send: the server stopped reading\n");
+		break;
+	default:
+		failExit("%s: %d %s\n", (event.failure == NET_FAILURE_CONNECT) ? "connect" : (event.failure == NET_FAILURE_SEND) ? "send" : "recv",
+			event.error, strerror(event.error));
+		break;
 	}
-	else if (bytes > 0) {
-		switch (recvBuffer[0]) {
-		case 0x00:
-			networkState.gameStarted = true;
-			networkState.systemColor = (Color)recvBuffer[1];
-			// Ensure player doesn't try to move if turn packet is delayed
-			gameState.playerTurn = (Color)(!(bool)networkState.systemColor);
+}
 
+// Handles everything the network thread received since the last frame.
+void networkUpdate() {
+	NetEvent event;
+	while (netClient.running && popNetEvent(netClient.inbound, event)) {
+		switch (event.type) {
+		case NET_CONNECTED:
+			networkState.connected = true;
 			consoleClear();
-			printf("Game started. You are color %s.\n", ((bool)networkState.systemColor) ? "black" : "white");
-
-			break;
-		case 0x01:
-			gameState.playerTurn = (Color)recvBuffer[1];
+			printf("Connected, waiting for opponent.\n");
 			break;
-		case 0x02:
-			Position begin, end;
-			begin.column = recvBuffer[1];
-			begin.row = recvBuffer[2];
-			end.column = recvBuffer[3];
-			end.row = recvBuffer[4];
-			if (recvBuffer[5] != 0) {
-				chessBoard[begin.column][begin.row].currentPiece = (Piece)recvBuffer[5];
-			}
-			movePiece(begin, end);
+		case NET_MESSAGE:
+			netHandleMessage(event.message, event.length);
 			break;
-		case 0x03:
-			switch (recvBuffer[1]) {
-			case 0x00:
-				// Error. Ideally shouldn't happen.
-				failExit("Game over: error.\n");
-				break;
-			case 0x01:
-				// Draw.
-				printf("Game over: draw.\n");
-				// Socket will close, throwing error, and making user exit.
-				break;
-			case 0x02:
-				printf("Game over: %s won.\n", ((bool)recvBuffer) ? "black" : "white");
-				break;
-			}
+		case NET_FAILED:
+			netHandleFailure(event);
 			break;
 		}
 	}
 }
 
-void netSendMove(Position start, Position end, Piece promotion) {
-	char sendBuffer[6];
-	sendBuffer[0] = 0x02;
-	sendBuffer[1] = start.column;
-	sendBuffer[2] = start.row;
-	sendBuffer[3] = end.column;
-	sendBuffer[4] = end.row;
-	if (promotion == none) {
-		if (send(sock, sendBuffer, 5, 0) < 0) {
-			failExit("send: %d %s\n", errno, strerror(errno));
-		}
+// Hands the move to the network thread, which sends it within NET_POLL_MS. Nothing is sent once the game is over.
+void netSendMove(Move move) {
+	if (!netClient.running) {
+		return;
 	}
-	else {
-		sendBuffer[5] = promotion;
-		if (send(sock, sendBuffer, 6, 0) < 0) {
-			failExit("send: %d %s\n", errno, strerror(errno));
-		}
+	NetEvent event;
+	event.type = NET_MESSAGE;
+	event.length = writeMoveMessage(event.message, move);
+	event.error = 0;
+	if (!pushNetEvent(netClient.outbound, event)) {
+		failExit("send: the move queue is full\n");
 	}
 }
 
 void failExit(const char* fmt, ...) {
 	//---------------------------------------------------------------------------------
 
-	if (sock > 0) close(sock);
+	stopNetClient(netClient);
 
 	va_list ap;
 
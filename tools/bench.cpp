@@ -0,0 +1,395 @@
+// Microbenchmarks for the rules code the game runs on the move-commit frame.
+//
+// bench [-t seconds] [-o results.json] [-l label] [-c baseline.json]
+//
+// Every benchmark reports nanoseconds and heap allocations per operation. With -o the results are also
+// written as JSON, and -c compares this run against an earlier JSON file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <chrono>
+
+#include "game.h"
+#include "engine/fen.h"
+#include "engine/mcts.h"
+
+// Counts every operator new in the process, so allocations/op covers the engine and anything it calls.
+static u64 allocations = 0;
+
+void* operator new(size_t size) {
+   allocations++;
+   void* p = malloc(size ? size : 1);
+   if (!p) {
+      abort();
+   }
+   return p;
+}
+
+void* operator new[](size_t size) {
+   return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+   free(p);
+}
+
+void operator delete[](void* p) noexcept {
+   free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+   free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+   free(p);
+}
+
+struct BenchPosition {
+   const char* name;
+   const char* fen;
+};
+
+const BenchPosition POSITIONS[] = {
+   { "opening", START_FEN },
+   { "middlegame", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1" },
+   { "endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1" }
+};
+
+// Morphy's Opera Game without the final mate, so replaying it never prints a result.
+const char* const GAME[] = {
+   "e2e4", "e7e5", "g1f3", "d7d6", "d2d4", "c8g4", "d4e5", "g4f3", "d1f3", "d6e5", "f1c4", "g8f6",
+   "f3b3", "d8e7", "b1c3", "c7c6", "c1g5", "b7b5", "c3b5", "c6b5", "c4b5", "b8d7", "e1c1", "a8d8",
+   "d1d7", "d8d7", "h1d1", "e7e6", "b5d7", "f6d7", "b3b8", "d7b8"
+};
+const u16 GAME_LENGTH = sizeof(GAME) / sizeof(GAME[0]);
+// Games a server process would host side by side, for the footprint benchmark
+#define HOSTED_GAMES 10000
+
+struct Result {
+   char name[64];
+   double nsPerOp;
+   double allocationsPerOp;
+   u64 operations;
+};
+
+Result results[64];
+u16 resultCount = 0;
+
+double minimumSeconds = 0.25;
+
+// Stops the compiler from dropping work whose result is otherwise unused.
+volatile u64 sink;
+
+typedef u64 (*BenchFunction)(void* context, u64 iterations);
+
+// Runs the function with growing iteration counts until one run takes long enough, then keeps the best of three.
+void bench(const char* name, BenchFunction function, void* context) {
+   u64 iterations = 1;
+   double best = 0;
+   double bestAllocations = 0;
+   u64 operations = 0;
+   for (u8 repeat = 0; repeat < 3; repeat++) {
+      while (true) {
+         u64 allocationsBefore = allocations;
+         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+         u64 ops = function(context, iterations);
+         double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+         if (seconds < minimumSeconds && repeat == 0) {
+            iterations *= 2;
+            continue;
+         }
+         double nsPerOp = seconds * 1e9 / ops;
+         if (!operations || nsPerOp < best) {
+            best = nsPerOp;
+            bestAllocations = (double)(allocations - allocationsBefore) / ops;
+            operations = ops;
+         }
+         break;
+      }
+   }
+
+   Result &result = results[resultCount++];
+   snprintf(result.name, sizeof(result.name), "%s", name);
+   result.nsPerOp = best;
+   result.allocationsPerOp = bestAllocations;
+   result.operations = operations;
+   printf("%-36s %12.1f ns/op %10.2f allocs/op\n", name, best, bestAllocations);
+}
+
+struct PieceContext {
+   Board boards[3];
+   Piece piece;
+};
+
+u64 benchPieceMoves(void* context, u64 iterations) {
+   PieceContext &c = *(PieceContext*)context;
+   MoveList moveList;
+   u64 ops = 0;
+   for (u64 i = 0; i < iterations; i++) {
+      for (u8 p = 0; p < 3; p++) {
+         Bitboard pieces = c.boards[p].pieces[c.boards[p].turn][c.piece];
+         while (pieces) {
+            Position position = positionOf(popLowestSquare(pieces));
+            moveList.size = 0;
+            calculatePieceMoves(c.boards[p], position, moveList);
+            sink = moveList.size;
+            ops++;
+         }
+      }
+   }
+   return ops;
+}
+
+u64 benchAllMoves(void* context, u64 iterations) {
+   const Board &position = *(const Board*)context;
+   game.board = position;
+   for (u64 i = 0; i < iterations; i++) {
+      calculateAllMoves(game);
+      sink = game.legality.checkers;
+   }
+   return iterations;
+}
+
+u64 benchMovePiece(void* context, u64 iterations) {
+   const Move* moves = (const Move*)context;
+   u64 ops = 0;
+   for (u64 i = 0; i < iterations; i++) {
+      setupBoard();
+      for (u16 m = 0; m < GAME_LENGTH; m++) {
+         movePiece(game, moves[m]);
+         ops++;
+      }
+   }
+   return ops;
+}
+
+struct HostedContext {
+   Game* games;
+   const Move* moves;
+};
+
+// Plays the game in every hosted game in turn, a move at a time, the way a server interleaves its matches.
+u64 benchHostedGames(void* context, u64 iterations) {
+   HostedContext &c = *(HostedContext*)context;
+   u64 ops = 0;
+   for (u64 i = 0; i < iterations; i++) {
+      for (u32 g = 0; g < HOSTED_GAMES; g++) {
+         setupGame(c.games[g]);
+         calculateAllMoves(c.games[g]);
+      }
+      for (u16 m = 0; m < GAME_LENGTH; m++) {
+         for (u32 g = 0; g < HOSTED_GAMES; g++) {
+            movePiece(c.games[g], c.moves[m]);
+            ops++;
+         }
+      }
+   }
+   return ops;
+}
+
+struct ValidMoveContext {
+   Position starts[64 * 8];
+   Position ends[64 * 8];
+   u16 count;
+};
+
+u64 benchValidMove(void* context, u64 iterations) {
+   const ValidMoveContext &c = *(const ValidMoveContext*)context;
+   u64 found = 0;
+   for (u64 i = 0; i < iterations; i++) {
+      for (u16 k = 0; k < c.count; k++) {
+         found += validMove(game, c.starts[k], c.ends[k]) != MOVE_NONE;
+      }
+   }
+   sink = found;
+   return iterations * c.count;
+}
+
+u64 benchPlayout(void* context, u64 iterations) {
+   const Board &position = *(const Board*)context;
+   u64 random = 1;
+   u64 plies = 0;
+   for (u64 i = 0; i < iterations; i++) {
+      Board board = position;
+      u16 played;
+      playout(board, random, played);
+      plies += played;
+   }
+   sink = plies;
+   return iterations;
+}
+
+// Writes text as a JSON string, escaping quotes, backslashes and control characters.
+void writeJsonString(FILE* file, const char* text) {
+   fputc('"', file);
+   for (const char* c = text; *c; c++) {
+      if (*c == '"' || *c == '\\') {
+         fprintf(file, "\\%c", *c);
+      }
+      else if ((unsigned char)*c < 0x20) {
+         fprintf(file, "\\u%04x", (unsigned char)*c);
+      }
+      else {
+         fputc(*c, file);
+      }
+   }
+   fputc('"', file);
+}
+
+void writeJson(const char* path, const char* label) {
+   FILE* file = fopen(path, "w");
+   if (!file) {
+      fprintf(stderr, "can't write %s\n", path);
+      exit(1);
+   }
+   fprintf(file, "{\n  \"label\": ");
+   writeJsonString(file, label);
+   fprintf(file, ",\n  \"benchmarks\": [\n");
+   for (u16 i = 0; i < resultCount; i++) {
+      fprintf(file, "    { \"name\": \"%s\", \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f, \"operations\": %llu }%s\n",
+         results[i].name, results[i].nsPerOp, results[i].allocationsPerOp, (unsigned long long)results[i].operations,
+         (i + 1 < resultCount) ? "," : "");
+   }
+   fprintf(file, "  ]\n}\n");
+   fclose(file);
+}
+
+// Reads a file written by writeJson() and prints the change of every benchmark present in both runs.
+void compareJson(const char* path) {
+   FILE* file = fopen(path, "r");
+   if (!file) {
+      fprintf(stderr, "can't read %s\n", path);
+      exit(1);
+   }
+   printf("\n%-36s %12s %12s %9s\n", "compared with", "before", "now", "change");
+   char line[256];
+   while (fgets(line, sizeof(line), file)) {
+      char name[64];
+      double nsPerOp;
+      if (sscanf(line, " { \"name\": \"%63[^\"]\", \"ns_per_op\": %lf", name, &nsPerOp) != 2) {
+         continue;
+      }
+      for (u16 i = 0; i < resultCount; i++) {
+         if (!strcmp(results[i].name, name)) {
+            printf("%-36s %12.1f %12.1f %+8.1f%%\n", name, nsPerOp, results[i].nsPerOp, (results[i].nsPerOp / nsPerOp - 1) * 100);
+         }
+      }
+   }
+   fclose(file);
+}
+
+int main(int argc, char* argv[]) {
+   const char* output = NULL;
+   const char* baseline = NULL;
+   const char* label = "";
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         minimumSeconds = atof(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+         output = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+         label = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+         baseline = argv[++i];
+      }
+      else {
+         fprintf(stderr, "usage: %s [-t seconds] [-o results.json] [-l label] [-c baseline.json]\n", argv[0]);
+         return 2;
+      }
+   }
+
+   initBitboards();
+   initZobrist();
+   const u8 POSITION_COUNT = sizeof(POSITIONS) / sizeof(POSITIONS[0]);
+   Board positions[POSITION_COUNT];
+   for (u8 p = 0; p < POSITION_COUNT; p++) {
+      loadFen(positions[p], POSITIONS[p].fen);
+   }
+
+   // calculatePieceMoves, over every piece of the type in all positions
+   const char* const PIECE_NAMES[] = { "", "king", "queen", "rook", "knight", "bishop", "pawn" };
+   PieceContext pieceContext;
+   for (u8 p = 0; p < POSITION_COUNT; p++) {
+      pieceContext.boards[p] = positions[p];
+   }
+   for (u8 piece = king; piece <= pawn; piece++) {
+      char name[64];
+      snprintf(name, sizeof(name), "calculatePieceMoves/%s", PIECE_NAMES[piece]);
+      pieceContext.piece = (Piece)piece;
+      bench(name, benchPieceMoves, &pieceContext);
+   }
+
+   // calculateAllMoves
+   for (u8 p = 0; p < POSITION_COUNT; p++) {
+      char name[64];
+      snprintf(name, sizeof(name), "calculateAllMoves/%s", POSITIONS[p].name);
+      bench(name, benchAllMoves, &positions[p]);
+   }
+
+   // movePiece, replaying a whole game one move at a time
+   Move gameMoves[GAME_LENGTH];
+   MoveList legalMoves;
+   setupBoard();
+   for (u16 m = 0; m < GAME_LENGTH; m++) {
+      calculateLegalMoves(game.board, legalMoves);
+      gameMoves[m] = stringToMove(legalMoves, GAME[m]);
+      if (!gameMoves[m]) {
+         fprintf(stderr, "benchmark game has an illegal move: %s\n", GAME[m]);
+         return 1;
+      }
+      movePiece(game, gameMoves[m]);
+   }
+   bench("movePiece/game", benchMovePiece, gameMoves);
+
+   // movePiece again, across HOSTED_GAMES separate games without a move cache
+   printf("%-36s %12zu bytes/game (board %zu, moves %zu, history %zu, record %zu)\n", "Game", sizeof(Game),
+      sizeof(Board), sizeof(MoveList), sizeof(PositionHistory), sizeof(game.moves) + sizeof(Board));
+   HostedContext hostedContext;
+   hostedContext.games = (Game*)malloc(sizeof(Game) * HOSTED_GAMES);
+   hostedContext.moves = gameMoves;
+   if (!hostedContext.games) {
+      fprintf(stderr, "can't allocate %d games\n", HOSTED_GAMES);
+      return 1;
+   }
+   for (u32 g = 0; g < HOSTED_GAMES; g++) {
+      hostedContext.games[g].moveCache = NULL;
+   }
+   char hostedName[64];
+   snprintf(hostedName, sizeof(hostedName), "movePiece/%dgames", HOSTED_GAMES);
+   bench(hostedName, benchHostedGames, &hostedContext);
+   free(hostedContext.games);
+
+   // validMove, with every legal move of the middlegame position plus as many rejected ones
+   ValidMoveContext validContext;
+   validContext.count = 0;
+   game.board = positions[1];
+   calculateAllMoves(game);
+   calculateLegalMoves(game.board, legalMoves);
+   for (u16 i = 0; i < legalMoves.size; i++) {
+      validContext.starts[validContext.count] = positionOf(moveFrom(legalMoves.moves[i]));
+      validContext.ends[validContext.count++] = positionOf(moveTo(legalMoves.moves[i]));
+      validContext.starts[validContext.count] = positionOf(moveTo(legalMoves.moves[i]));
+      validContext.ends[validContext.count++] = positionOf(moveFrom(legalMoves.moves[i]));
+   }
+   bench("validMove/middlegame", benchValidMove, &validContext);
+
+   // playout, a random game to the end from each position
+   for (u8 p = 0; p < POSITION_COUNT; p++) {
+      char name[64];
+      snprintf(name, sizeof(name), "playout/%s", POSITIONS[p].name);
+      bench(name, benchPlayout, &positions[p]);
+   }
+
+   if (output) {
+      writeJson(output, label);
+   }
+   if (baseline) {
+      compareJson(baseline);
+   }
+   return 0;
+}
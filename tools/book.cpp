@@ -0,0 +1,245 @@
+// Builds an opening book from PGN games, and looks positions up in one.
+//
+// book -o <book> [-p plies] [-g games] <pgn>...
+//                      every position in the first DEFAULT_PLIES (or -p) plies of each game, keeping the moves
+//                      played in at least DEFAULT_MIN_GAMES (or -g) games. A move's weight is two points for
+//                      every game the side that played it won and one for every draw.
+// book -l <book> [-f fen]
+//                      the book's moves in the start position or the given one
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "engine/book.h"
+#include "engine/fen.h"
+#include "engine/pgn.h"
+#include "engine/san.h"
+
+#define DEFAULT_PLIES 20
+#define MAX_PLIES 64
+#define DEFAULT_MIN_GAMES 2
+
+// A move played in a position, with the totals of the games it was played in
+struct BookMove {
+   u64 key;
+   Move move;
+   u32 games;
+   u32 points;
+};
+
+bool compareBookMoves(const BookMove &a, const BookMove &b) {
+   return (a.key != b.key) ? a.key < b.key : a.move < b.move;
+}
+
+std::vector<BookMove> bookMoves;
+u64 gamesRead = 0;
+u64 gamesSkipped = 0;
+
+// Replays every game of the file, adding a BookMove for each of the first plies moves once the result is known.
+// Games with a move that can't be read are skipped from that move on, but what came before still counts.
+bool readGames(const char* path, u8 plies) {
+   FILE* file = fopen(path, "r");
+   if (!file) {
+      fprintf(stderr, "can't open %s\n", path);
+      return false;
+   }
+   PgnReader reader;
+   initPgnReader(reader, file);
+
+   Board board;
+   setupStartPosition(board);
+   BookMove played[MAX_PLIES];
+   Color movers[MAX_PLIES];
+   u8 playedCount = 0;
+   u16 ply = 0;
+   bool valid = true;
+   bool gameOver = false;
+   PgnToken token;
+   while ((token = nextPgnToken(reader)) != PGN_END) {
+      if (gameOver || (token == PGN_TAG && ply)) {
+         // Tags or moves after a result start the next game, and so do tags after moves when the result is
+         // missing.
+         setupStartPosition(board);
+         playedCount = 0;
+         ply = 0;
+         valid = true;
+         gameOver = false;
+      }
+      if (token == PGN_TAG) {
+         if (!strcmp(reader.tag, "FEN") && !loadFen(board, reader.text)) {
+            fprintf(stderr, "%s:%u: invalid fen: %s\n", path, reader.line, reader.text);
+            valid = false;
+         }
+      }
+      else if (token == PGN_MOVE) {
+         if (!valid || ply >= plies) {
+            continue;
+         }
+         MoveList moves;
+         calculateLegalMoves(board, moves);
+         Move move = parseSan(board, moves, reader.text);
+         if (!move) {
+            fprintf(stderr, "%s:%u: can't play %s\n", path, reader.line, reader.text);
+            gamesSkipped++;
+            valid = false;
+            continue;
+         }
+         movers[playedCount] = board.turn;
+         played[playedCount].key = board.key;
+         played[playedCount].move = move;
+         playedCount++;
+         Undo undo;
+         makeMove(board, move, undo);
+         ply++;
+      }
+      else if (token == PGN_RESULT) {
+         gameOver = true;
+         gamesRead++;
+         // Unfinished games only count as having been played.
+         u8 whitePoints = !strcmp(reader.text, "1-0") ? 2 : !strcmp(reader.text, "1/2-1/2") ? 1 : !strcmp(reader.text, "0-1") ? 0 : 1;
+         for (u8 i = 0; i < playedCount; i++) {
+            played[i].games = 1;
+            played[i].points = (movers[i] == white) ? whitePoints : 2 - whitePoints;
+            bookMoves.push_back(played[i]);
+         }
+      }
+   }
+   fclose(file);
+   return true;
+}
+
+int build(const char* output, u8 plies, u32 minGames, char** inputs, int inputCount) {
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (int i = 0; i < inputCount; i++) {
+      if (!readGames(inputs[i], plies)) {
+         return 1;
+      }
+   }
+
+   // Merge the moves played in the same position, then drop the rare and the losing ones.
+   std::sort(bookMoves.begin(), bookMoves.end(), compareBookMoves);
+   std::vector<BookMove> merged;
+   for (size_t i = 0; i < bookMoves.size();) {
+      BookMove total = bookMoves[i];
+      for (i++; i < bookMoves.size() && bookMoves[i].key == total.key && bookMoves[i].move == total.move; i++) {
+         total.games += bookMoves[i].games;
+         total.points += bookMoves[i].points;
+      }
+      if (total.games >= minGames && total.points) {
+         merged.push_back(total);
+      }
+   }
+
+   // Weights are 16 bits, so a position whose points don't fit has them all scaled down together.
+   std::vector<BookRecord> records;
+   for (size_t first = 0; first < merged.size();) {
+      size_t last = first;
+      u32 most = 0;
+      for (; last < merged.size() && merged[last].key == merged[first].key; last++) {
+         most = std::max(most, merged[last].points);
+      }
+      for (; first < last; first++) {
+         BookRecord record;
+         record.key = merged[first].key;
+         record.move = merged[first].move;
+         record.weight = (most <= 65535) ? merged[first].points : std::max<u64>(1, (u64)merged[first].points * 65535 / most);
+         records.push_back(record);
+      }
+   }
+
+   FILE* file = fopen(output, "wb");
+   if (!file) {
+      fprintf(stderr, "can't write %s\n", output);
+      return 1;
+   }
+   u8 header[BOOK_HEADER_SIZE];
+   encodeBookHeader(records.size(), header);
+   fwrite(header, sizeof(header), 1, file);
+   for (size_t i = 0; i < records.size(); i++) {
+      u8 bytes[BOOK_RECORD_SIZE];
+      encodeBookRecord(records[i], bytes);
+      fwrite(bytes, sizeof(bytes), 1, file);
+   }
+   if (fclose(file) != 0) {
+      fprintf(stderr, "can't write %s\n", output);
+      return 1;
+   }
+
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   printf("%llu games (%llu cut short), %llu moves, %llu records, %llu bytes in %.2fs\n", (unsigned long long)gamesRead,
+      (unsigned long long)gamesSkipped, (unsigned long long)bookMoves.size(), (unsigned long long)records.size(),
+      (unsigned long long)(BOOK_HEADER_SIZE + records.size() * BOOK_RECORD_SIZE), seconds);
+   return 0;
+}
+
+int list(const char* path, const char* fen) {
+   OpeningBook book;
+   if (!openBook(book, path)) {
+      fprintf(stderr, "can't open %s as a book\n", path);
+      return 1;
+   }
+   Board board;
+   if (!loadFen(board, fen)) {
+      fprintf(stderr, "invalid fen: %s\n", fen);
+      return 2;
+   }
+
+   BookRecord records[MAX_BOOK_MOVES];
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   u8 found = findBookRecords(book, board.key, records);
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   u32 total = 0;
+   for (u8 i = 0; i < found; i++) {
+      total += records[i].weight;
+   }
+   printf("%u records, %u moves found in %.1f us\n", book.count, found, seconds * 1e6);
+   for (u8 i = 0; i < found; i++) {
+      char text[6];
+      printf("%-6s %6u  %5.1f%%\n", moveToString(records[i].move, text), records[i].weight, 100.0 * records[i].weight / total);
+   }
+   closeBook(book);
+   return 0;
+}
+
+int main(int argc, char* argv[]) {
+   const char* output = NULL;
+   const char* listed = NULL;
+   const char* fen = START_FEN;
+   int plies = DEFAULT_PLIES;
+   int minGames = DEFAULT_MIN_GAMES;
+   int i = 1;
+   for (; i < argc && argv[i][0] == '-'; i++) {
+      if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+         output = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+         listed = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+         fen = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+         plies = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+         minGames = atoi(argv[++i]);
+      }
+      else {
+         break;
+      }
+   }
+   if ((!output == !listed) || (output && i == argc) || (listed && i != argc) || plies < 1 || plies > MAX_PLIES) {
+      fprintf(stderr, "usage: %s -o book [-p plies] [-g games] pgn...\n       %s -l book [-f fen]\n", argv[0], argv[0]);
+      return 2;
+   }
+
+   initBitboards();
+   initZobrist();
+   if (listed) {
+      return list(listed, fen);
+   }
+   return build(output, plies, minGames, argv + i, argc - i);
+}
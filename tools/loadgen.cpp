@@ -0,0 +1,395 @@
+// Simulates 3DS clients against the match server, for capacity planning and testing without the live server.
+//
+// loadgen [-a address] [-p port] [-c clients] [-s seconds] [-m plies] [-i percent]
+//
+// Every client connects, says hello and once paired plays a random legal move the moment it's its turn, like a
+// 3DS whose player never thinks. When its game is over it connects again for another one, and a game still
+// going after -m plies is abandoned the same way, so the server sees a steady stream of moves, game starts and
+// game ends. With -i, that percentage of moves are replaced by illegal ones, which the server should reject by
+// ending the game. All clients share one epoll loop.
+//
+// At the end it prints the moves relayed per second, how the games ended, and the relay latency percentiles.
+// The latency is half the time from sending a move to the opponent's reply arriving: the opponent answers as
+// soon as the move reaches it, so that is the time one move takes through the server and both event loops.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "engine/movegen.h"
+#include "engine/protocol.h"
+
+#define DEFAULT_CLIENTS 1000
+#define DEFAULT_SECONDS 10.0
+// Plies after which a client gives up on its game
+#define DEFAULT_MAX_PLIES 200
+#define EVENTS_PER_WAIT 1024
+#define WAIT_MS 10
+// Failed connections in a row after which the server is taken to be down
+#define MAX_CONNECT_FAILURES 100
+
+enum SimulatedState : u8 { SIMULATED_CONNECTING, SIMULATED_WAITING, SIMULATED_PLAYING };
+
+struct SimulatedClient {
+   int fd;
+   SimulatedState state;
+   Color color;
+   u16 plies;
+   // Counts the connections, so events of an earlier one are told apart
+   u32 generation;
+   // Nanoseconds since the start when the last move was sent, 0 once the reply is in
+   u64 sentAt;
+   u64 random;
+   Board board;
+   RingBuffer input;
+   RingBuffer output;
+};
+
+struct LoadStats {
+   u64 movesSent;
+   u64 movesReceived;
+   // [GameOverReason], and last those with a reason this side doesn't know
+   u64 gameOvers[GAME_OVER_REASONS + 1];
+   u64 illegalSent;
+   u64 abandoned;
+   u64 connectFailures;
+   u64 disconnects;
+};
+
+std::vector<SimulatedClient> clients;
+std::vector<u32> latencies;
+LoadStats stats;
+sockaddr_in serverAddress;
+int epollFd;
+u16 maxPlies = DEFAULT_MAX_PLIES;
+u8 illegalPercent = 0;
+u32 failuresInARow = 0;
+std::chrono::steady_clock::time_point startTime;
+
+u64 now() {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void connectClient(u32 index) {
+   SimulatedClient &client = clients[index];
+   client.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+   if (client.fd < 0) {
+      fprintf(stderr, "socket: %s\n", strerror(errno));
+      exit(1);
+   }
+   int on = 1;
+   setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+   if (connect(client.fd, (sockaddr*)&serverAddress, sizeof(serverAddress)) < 0 && errno != EINPROGRESS) {
+      fprintf(stderr, "connect: %s\n", strerror(errno));
+      exit(1);
+   }
+   client.state = SIMULATED_CONNECTING;
+   clearRing(client.input);
+   clearRing(client.output);
+   client.sentAt = 0;
+   client.generation++;
+   epoll_event event;
+   event.events = EPOLLOUT;
+   event.data.u64 = (u64)client.generation << 32 | index;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &event);
+}
+
+void reconnectClient(u32 index) {
+   close(clients[index].fd);
+   connectClient(index);
+}
+
+// Sends the message in a frame, with anything the socket didn't take last time. Returns false if the
+// connection is gone.
+bool sendMessage(SimulatedClient &client, const u8* message, u8 length) {
+   if (!writeFrame(client.output, message, length)) {
+      return false;
+   }
+   while (ringUsed(client.output)) {
+      u32 size;
+      const u8* data = ringData(client.output, size);
+      ssize_t sent;
+      while ((sent = send(client.fd, data, size, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+      if (sent < 0) {
+         return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      ringRemoved(client.output, sent);
+   }
+   return true;
+}
+
+// A move of one of the client's pieces that the rules don't allow, or MOVE_NONE if none turns up.
+Move illegalMove(SimulatedClient &client, const MoveList &legal) {
+   const Board &board = client.board;
+   for (u16 tries = 0; tries < 1024; tries++) {
+      u8 from = nextRandom(client.random) % 64;
+      u8 to = nextRandom(client.random) % 64;
+      if (from == to || !(board.colors[client.color] & BIT(from))) {
+         continue;
+      }
+      bool allowed = false;
+      for (u16 i = 0; i < legal.size && !allowed; i++) {
+         allowed = moveFrom(legal.moves[i]) == from && moveTo(legal.moves[i]) == to;
+      }
+      if (!allowed) {
+         return inferMove(board, from, to, (pieceOn(board, from) == pawn && (to < 8 || to >= 56)) ? queen : none);
+      }
+   }
+   return MOVE_NONE;
+}
+
+// Plays a random legal move if it's the client's turn.
+void playTurn(u32 index) {
+   SimulatedClient &client = clients[index];
+   if (client.state != SIMULATED_PLAYING || client.board.turn != client.color || client.sentAt) {
+      return;
+   }
+   if (client.plies >= maxPlies) {
+      stats.abandoned++;
+      reconnectClient(index);
+      return;
+   }
+   MoveList moves;
+   calculateLegalMoves(client.board, moves);
+   // Mate or stalemate, the game over is on its way.
+   if (!moves.size) {
+      return;
+   }
+   Move move = moves.moves[nextRandom(client.random) % moves.size];
+   if (illegalPercent && nextRandom(client.random) % 100 < illegalPercent) {
+      Move illegal = illegalMove(client, moves);
+      if (illegal) {
+         u8 message[MAX_MESSAGE];
+         u8 length = writeMoveMessage(message, illegal);
+         client.sentAt = now();
+         if (!sendMessage(client, message, length)) {
+            stats.disconnects++;
+            reconnectClient(index);
+            return;
+         }
+         stats.illegalSent++;
+         return;
+      }
+   }
+   u8 message[MAX_MESSAGE];
+   u8 length = writeMoveMessage(message, move);
+   Undo undo;
+   makeMove(client.board, move, undo);
+   client.plies++;
+   client.sentAt = now();
+   if (!sendMessage(client, message, length)) {
+      stats.disconnects++;
+      reconnectClient(index);
+      return;
+   }
+   stats.movesSent++;
+}
+
+void readMessages(u32 index) {
+   SimulatedClient &client = clients[index];
+   u32 space;
+   u8* into = ringSpace(client.input, space);
+   ssize_t bytes;
+   while ((bytes = recv(client.fd, into, space, 0)) == -1 && errno == EINTR);
+   if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+   }
+   if (bytes <= 0) {
+      stats.disconnects++;
+      reconnectClient(index);
+      return;
+   }
+   ringAdded(client.input, bytes);
+
+   while (true) {
+      u8 message[MAX_MESSAGE];
+      u8 length;
+      FrameResult result = readFrame(client.input, message, length);
+      if (result == FRAME_INVALID) {
+         fprintf(stderr, "server sent an invalid frame: 0x%02X 0x%02X\n", ringByte(client.input, 0), ringByte(client.input, 1));
+         exit(1);
+      }
+      if (result == FRAME_INCOMPLETE) {
+         break;
+      }
+      switch (message[0]) {
+      case MESSAGE_GAME_START:
+         client.state = SIMULATED_PLAYING;
+         client.color = (Color)message[1];
+         client.plies = 0;
+         client.sentAt = 0;
+         setupStartPosition(client.board);
+         break;
+      case MESSAGE_MOVE: {
+         Undo undo;
+         makeMove(client.board, readMoveMessage(message, length, client.board), undo);
+         client.plies++;
+         stats.movesReceived++;
+         if (client.sentAt) {
+            u64 latency = (now() - client.sentAt) / 2;
+            latencies.push_back((latency > 0xFFFFFFFF) ? 0xFFFFFFFF : (u32)latency);
+            client.sentAt = 0;
+         }
+         break;
+      }
+      case MESSAGE_GAME_OVER:
+         stats.gameOvers[(message[1] < GAME_OVER_REASONS) ? message[1] : (u8)GAME_OVER_REASONS]++;
+         reconnectClient(index);
+         return;
+      default:
+         break;
+      }
+   }
+   playTurn(index);
+}
+
+void finishConnect(u32 index) {
+   SimulatedClient &client = clients[index];
+   int error = 0;
+   socklen_t size = sizeof(error);
+   getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &size);
+   if (error) {
+      stats.connectFailures++;
+      if (++failuresInARow >= MAX_CONNECT_FAILURES) {
+         fprintf(stderr, "can't connect to the server: %s\n", strerror(error));
+         exit(1);
+      }
+      reconnectClient(index);
+      return;
+   }
+   failuresInARow = 0;
+   epoll_event event;
+   event.events = EPOLLIN;
+   event.data.u64 = (u64)client.generation << 32 | index;
+   epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &event);
+   u8 hello = MESSAGE_HELLO;
+   if (!sendMessage(client, &hello, 1)) {
+      stats.disconnects++;
+      reconnectClient(index);
+      return;
+   }
+   client.state = SIMULATED_WAITING;
+}
+
+double percentile(double fraction) {
+   if (latencies.empty()) {
+      return 0;
+   }
+   size_t rank = (size_t)(fraction * (latencies.size() - 1));
+   std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+   return latencies[rank] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+   const char* address = "127.0.0.1";
+   int port = PROTOCOL_PORT;
+   int clientCount = DEFAULT_CLIENTS;
+   double seconds = DEFAULT_SECONDS;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+         address = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+         port = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+         clientCount = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+         seconds = atof(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+         maxPlies = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+         int percent = atoi(argv[++i]);
+         illegalPercent = (percent < 0) ? 0 : (percent > 100) ? 100 : percent;
+      }
+      else {
+         fprintf(stderr, "usage: %s [-a address] [-p port] [-c clients] [-s seconds] [-m plies] [-i percent]\n", argv[0]);
+         return 2;
+      }
+   }
+   if (clientCount < 2) {
+      clientCount = 2;
+   }
+   memset(&serverAddress, 0, sizeof(serverAddress));
+   serverAddress.sin_family = AF_INET;
+   serverAddress.sin_port = htons(port);
+   if (inet_pton(AF_INET, address, &serverAddress.sin_addr) != 1) {
+      fprintf(stderr, "invalid address: %s\n", address);
+      return 2;
+   }
+
+   initBitboards();
+   initZobrist();
+   rlimit limit;
+   if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max) {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+   }
+   epollFd = epoll_create1(0);
+   memset(&stats, 0, sizeof(stats));
+   latencies.reserve(1 << 20);
+   startTime = std::chrono::steady_clock::now();
+   clients.resize(clientCount);
+   for (int i = 0; i < clientCount; i++) {
+      clients[i].random = i + 1;
+      clients[i].generation = 0;
+      connectClient(i);
+   }
+
+   std::vector<epoll_event> events(EVENTS_PER_WAIT);
+   u64 end = (u64)(seconds * 1e9);
+   while (now() < end) {
+      int ready = epoll_wait(epollFd, events.data(), EVENTS_PER_WAIT, WAIT_MS);
+      for (int i = 0; i < ready; i++) {
+         u32 index = (u32)events[i].data.u64;
+         if (clients[index].generation != events[i].data.u64 >> 32) {
+            continue;
+         }
+         if (clients[index].state == SIMULATED_CONNECTING) {
+            if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+               finishConnect(index);
+            }
+         }
+         else if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            readMessages(index);
+         }
+      }
+   }
+   double elapsed = now() / 1e9;
+
+   printf("%d clients, %.1fs\n", clientCount, elapsed);
+   printf("moves       %llu sent, %llu relayed, %.0f moves/s\n", (unsigned long long)stats.movesSent,
+      (unsigned long long)stats.movesReceived, stats.movesReceived / elapsed);
+   // Both players hear of every game over. The opponent of a client that gave up hears of it as an error.
+   u64 won = stats.gameOvers[GAME_OVER_WIN] / 2;
+   u64 drawn = stats.gameOvers[GAME_OVER_DRAW] / 2;
+   u64 errors = stats.gameOvers[GAME_OVER_ERROR] - std::min(stats.gameOvers[GAME_OVER_ERROR], stats.abandoned);
+   printf("games       %llu finished (%.1f/s): %llu won, %llu drawn; %llu abandoned after %u plies, %llu errors\n",
+      (unsigned long long)(won + drawn), (won + drawn) / elapsed, (unsigned long long)won, (unsigned long long)drawn,
+      (unsigned long long)stats.abandoned, maxPlies, (unsigned long long)errors);
+   printf("illegal     %llu sent, %llu rejected\n", (unsigned long long)stats.illegalSent,
+      (unsigned long long)stats.gameOvers[GAME_OVER_ILLEGAL_MOVE] / 2);
+   // Only the client of another version hears of it.
+   printf("game overs  %llu for another protocol version, %llu with an unknown reason\n",
+      (unsigned long long)stats.gameOvers[GAME_OVER_VERSION], (unsigned long long)stats.gameOvers[GAME_OVER_REASONS]);
+   printf("connections %llu failed, %llu dropped\n", (unsigned long long)stats.connectFailures,
+      (unsigned long long)stats.disconnects);
+   printf("latency     p50 %.1f us, p99 %.1f us, max %.1f us over %llu moves\n", percentile(0.5), percentile(0.99),
+      percentile(1.0), (unsigned long long)latencies.size());
+   return 0;
+}
@@ -0,0 +1,186 @@
+// Measures random playout throughput, and runs the Monte Carlo tree search.
+//
+// mcts [-t threads] [-s seconds]
+//                      playouts from each test position on every thread for DEFAULT_SECONDS (or -s), reporting
+//                      playouts per second in total and per thread, the average length and the results. Every
+//                      playout is move generation, makeMove() and mate detection all the way to the end of a
+//                      game, so this is also a check of the whole rules engine under load.
+// mcts -n <playouts> [-f fen] [-P megabytes]
+//                      the tree search on the test positions or the given one, with a node pool of that size,
+//                      printing its most visited moves
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "engine/mcts.h"
+#include "engine/fen.h"
+
+#define DEFAULT_SECONDS 2.0
+// Node pool of the tree search
+#define DEFAULT_POOL_MB 64
+// Moves printed after a tree search
+#define SHOWN_MOVES 5
+// Playouts run between looks at the clock
+#define PLAYOUTS_PER_CHECK 64
+
+const char* const POSITIONS[] = {
+   START_FEN,
+   "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+   "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+   "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"
+};
+const u8 POSITION_COUNT = sizeof(POSITIONS) / sizeof(POSITIONS[0]);
+
+// What one thread got through
+struct PlayoutCount {
+   u64 playouts;
+   u64 plies;
+   // [PlayoutResult]
+   u64 results[3];
+};
+
+void playoutWorker(const Board* start, u64 seed, double seconds, PlayoutCount* count) {
+   memset(count, 0, sizeof(*count));
+   u64 random = seed;
+   std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+   while (std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < seconds) {
+      for (u8 i = 0; i < PLAYOUTS_PER_CHECK; i++) {
+         Board board = *start;
+         u16 plies;
+         count->results[playout(board, random, plies)]++;
+         count->plies += plies;
+         count->playouts++;
+      }
+   }
+}
+
+int benchmark(u8 threadCount, double seconds) {
+   printf("%u threads, %.1fs per position\n\n%-12s %14s %14s %10s %8s %8s %8s\n", threadCount, seconds, "position",
+      "playouts/s", "per thread", "plies", "white", "draw", "black");
+   u64 totalPlayouts = 0;
+   u64 totalPlies = 0;
+   for (u8 p = 0; p < POSITION_COUNT; p++) {
+      Board board;
+      loadFen(board, POSITIONS[p]);
+      PlayoutCount counts[256];
+      std::thread threads[256];
+      for (u8 t = 1; t < threadCount; t++) {
+         threads[t] = std::thread(playoutWorker, &board, (u64)p << 32 | t, seconds, &counts[t]);
+      }
+      playoutWorker(&board, (u64)p << 32, seconds, &counts[0]);
+      for (u8 t = 1; t < threadCount; t++) {
+         threads[t].join();
+      }
+
+      PlayoutCount total;
+      memset(&total, 0, sizeof(total));
+      for (u8 t = 0; t < threadCount; t++) {
+         total.playouts += counts[t].playouts;
+         total.plies += counts[t].plies;
+         for (u8 r = 0; r < 3; r++) {
+            total.results[r] += counts[t].results[r];
+         }
+      }
+      char name[16];
+      snprintf(name, sizeof(name), "position%u", p + 1);
+      printf("%-12s %14.0f %14.0f %10.1f %7.1f%% %7.1f%% %7.1f%%\n", name, total.playouts / seconds,
+         total.playouts / seconds / threadCount, (double)total.plies / total.playouts,
+         100.0 * total.results[PLAYOUT_WHITE_WINS] / total.playouts, 100.0 * total.results[PLAYOUT_DRAW] / total.playouts,
+         100.0 * total.results[PLAYOUT_BLACK_WINS] / total.playouts);
+      totalPlayouts += total.playouts;
+      totalPlies += total.plies;
+   }
+   double totalSeconds = seconds * POSITION_COUNT;
+   printf("%-12s %14.0f %14.0f %10.1f\n", "total", totalPlayouts / totalSeconds, totalPlayouts / totalSeconds / threadCount,
+      (double)totalPlies / totalPlayouts);
+   printf("%.0f plies/s per thread\n", totalPlies / totalSeconds / threadCount);
+   return 0;
+}
+
+bool compareVisits(const MctsNode &a, const MctsNode &b) {
+   return a.visits > b.visits;
+}
+
+void searchPosition(Mcts &mcts, const Board &board, u64 playouts) {
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   startMcts(mcts, board, playouts, board.key);
+   while (!continueMcts(mcts, PLAYOUTS_PER_CHECK)) {}
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   char text[6];
+   Move best = bestMctsMove(mcts);
+   printf("bestmove %s  playouts %llu  nodes %u  time %.3fs  playouts/s %.0f  plies/playout %.1f\n",
+      best ? moveToString(best, text) : "none", (unsigned long long)mcts.playouts, mcts.used, seconds,
+      mcts.playouts / seconds, mcts.playouts ? (double)mcts.playoutPlies / mcts.playouts : 0.0);
+   const MctsNode &root = mcts.nodes[0];
+   if (root.childCount == MCTS_UNEXPANDED) {
+      return;
+   }
+   MctsNode* children = mcts.nodes + root.firstChild;
+   u16 shown = std::min<u16>(root.childCount, SHOWN_MOVES);
+   std::partial_sort(children, children + shown, children + root.childCount, compareVisits);
+   for (u16 i = 0; i < shown; i++) {
+      printf("   %-6s visits %9u  score %5.1f%%\n", moveToString(children[i].move, text), children[i].visits,
+         children[i].visits ? 50.0 * children[i].points / children[i].visits : 0.0);
+   }
+}
+
+int main(int argc, char* argv[]) {
+   int threads = std::thread::hardware_concurrency();
+   double seconds = DEFAULT_SECONDS;
+   long long playouts = 0;
+   const char* fen = NULL;
+   int poolMegabytes = DEFAULT_POOL_MB;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         threads = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+         seconds = atof(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+         playouts = atoll(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+         fen = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-P") && i + 1 < argc) {
+         poolMegabytes = atoi(argv[++i]);
+      }
+      else {
+         fprintf(stderr, "usage: %s [-t threads] [-s seconds]\n       %s -n playouts [-f fen] [-P megabytes]\n", argv[0], argv[0]);
+         return 2;
+      }
+   }
+
+   initBitboards();
+   initZobrist();
+   if (!playouts) {
+      return benchmark((threads < 1) ? 1 : (threads > 255) ? 255 : threads, seconds);
+   }
+
+   Mcts mcts;
+   if (!initMcts(mcts, poolMegabytes)) {
+      fprintf(stderr, "can't allocate %d MB of nodes\n", poolMegabytes);
+      return 1;
+   }
+   for (u8 p = 0; p < POSITION_COUNT; p++) {
+      const char* position = fen ? fen : POSITIONS[p];
+      Board board;
+      if (!loadFen(board, position)) {
+         fprintf(stderr, "invalid fen: %s\n", position);
+         return 2;
+      }
+      printf("%s\n", position);
+      searchPosition(mcts, board, playouts);
+      printf("\n");
+      if (fen) {
+         break;
+      }
+   }
+   freeMcts(mcts);
+   return 0;
+}
@@ -0,0 +1,239 @@
+// Runs the 3DS application's network thread (engine/netclient.h) on the host against the match server, to test
+// it and measure its queues without a 3DS.
+//
+// netclient [-a address] [-p port] [-c clients] [-s seconds] [-f fps] [-m plies]
+//
+// Every client is a NetClient with a thread of its own, and one game loop stands in for the 3DS's main loop:
+// once a frame it takes each client's events, plays the opponent's moves on the client's Game, and where it's
+// the client's turn queues a random legal move for the thread to send. A client connects again when its game
+// is over or has gone on for -m plies. At the end it prints the moves and, for the queue into the game loop and
+// the one out of it, how many events went through, how full the queue got and how long events waited in it.
+// Events into the game loop wait for its next frame, up to a frame's time; events out of it wait for the thread's
+// next look at the queue, up to NET_POLL_MS.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include "engine/game.h"
+#include "engine/netclient.h"
+
+#define MAX_CLIENTS 64
+#define DEFAULT_CLIENTS 2
+#define DEFAULT_SECONDS 10.0
+#define DEFAULT_FPS 60
+#define DEFAULT_MAX_PLIES 200
+
+// What the game loop knows about one client, like the 3DS's gameState and networkState
+struct TestClient {
+   Game game;
+   bool playing;
+   Color color;
+   u64 random;
+};
+
+// One direction of the queues, summed over every connection
+struct QueueTotals {
+   u64 events;
+   u64 full;
+   u64 depthTotal;
+   u32 maxDepth;
+   u64 waitTotal;
+   u64 maxWait;
+};
+
+struct TestStats {
+   u64 movesSent;
+   u64 movesReceived;
+   u64 finished;
+   u64 abandoned;
+   u64 failed;
+   QueueTotals inbound;
+   QueueTotals outbound;
+};
+
+NetClient netClients[MAX_CLIENTS];
+TestClient clients[MAX_CLIENTS];
+TestStats stats;
+const char* address = "127.0.0.1";
+u16 port = PROTOCOL_PORT;
+u16 maxPlies = DEFAULT_MAX_PLIES;
+
+void addQueue(QueueTotals &totals, const NetQueue &queue) {
+   totals.events += queue.head;
+   totals.full += queue.full;
+   totals.depthTotal += queue.depthTotal;
+   totals.waitTotal += queue.waitTotal;
+   if (queue.maxDepth > totals.maxDepth) {
+      totals.maxDepth = queue.maxDepth;
+   }
+   if (queue.maxWait > totals.maxWait) {
+      totals.maxWait = queue.maxWait;
+   }
+}
+
+void connectClient(u8 index) {
+   clients[index].playing = false;
+   if (!startNetClient(netClients[index], address, port)) {
+      fprintf(stderr, "connect: %s\n", strerror(errno));
+      exit(1);
+   }
+}
+
+// Stops the client's thread, which makes its counters safe to read, and connects again.
+void reconnectClient(u8 index) {
+   stopNetClient(netClients[index]);
+   addQueue(stats.inbound, netClients[index].inbound);
+   addQueue(stats.outbound, netClients[index].outbound);
+   connectClient(index);
+}
+
+// Returns false if the client connected again, and its remaining events are gone with the old connection.
+bool handleEvent(u8 index, const NetEvent &event) {
+   TestClient &client = clients[index];
+   if (event.type == NET_FAILED) {
+      stats.failed++;
+      fprintf(stderr, "client %d: failure %d, %s\n", index, event.failure, event.error ? strerror(event.error) : "no error");
+      reconnectClient(index);
+      return false;
+   }
+   if (event.type != NET_MESSAGE) {
+      return true;
+   }
+   switch (event.message[0]) {
+   case MESSAGE_GAME_START:
+      client.playing = true;
+      client.color = (Color)event.message[1];
+      setupGame(client.game);
+      calculateAllMoves(client.game);
+      break;
+   case MESSAGE_MOVE: {
+      Move move = readMoveMessage(event.message, event.length, client.game.board);
+      if (!allowedMove(client.game, move)) {
+         fprintf(stderr, "client %d: the server relayed a move the rules don't allow\n", index);
+         exit(1);
+      }
+      movePiece(client.game, move);
+      stats.movesReceived++;
+      break;
+   }
+   case MESSAGE_GAME_OVER:
+      stats.finished++;
+      reconnectClient(index);
+      return false;
+   default:
+      break;
+   }
+   return true;
+}
+
+// Plays a random legal move if it's the client's turn, as a player who never thinks.
+void playTurn(u8 index) {
+   TestClient &client = clients[index];
+   Game &game = client.game;
+   if (!client.playing || game.board.turn != client.color || game.end != GAME_ONGOING) {
+      return;
+   }
+   if (game.turns >= maxPlies) {
+      stats.abandoned++;
+      reconnectClient(index);
+      return;
+   }
+   MoveList moves;
+   calculateLegalMoves(game.board, moves);
+   Move move = moves.moves[nextRandom(client.random) % moves.size];
+   NetEvent event;
+   event.type = NET_MESSAGE;
+   event.length = writeMoveMessage(event.message, move);
+   event.error = 0;
+   if (!pushNetEvent(netClients[index].outbound, event)) {
+      fprintf(stderr, "client %d: the network thread stopped taking moves\n", index);
+      exit(1);
+   }
+   movePiece(game, move);
+   stats.movesSent++;
+}
+
+void printQueue(const char* name, const QueueTotals &totals) {
+   printf("%-9s %llu events, depth avg %.2f max %u, %llu full, wait avg %.0f us max %llu us\n", name,
+      (unsigned long long)totals.events, totals.events ? (double)totals.depthTotal / totals.events : 0.0,
+      totals.maxDepth, (unsigned long long)totals.full, totals.events ? (double)totals.waitTotal / totals.events : 0.0,
+      (unsigned long long)totals.maxWait);
+}
+
+int main(int argc, char* argv[]) {
+   int clientCount = DEFAULT_CLIENTS;
+   double seconds = DEFAULT_SECONDS;
+   int fps = DEFAULT_FPS;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+         address = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+         port = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+         clientCount = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+         seconds = atof(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+         fps = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+         maxPlies = atoi(argv[++i]);
+      }
+      else {
+         fprintf(stderr, "usage: %s [-a address] [-p port] [-c clients] [-s seconds] [-f fps] [-m plies]\n", argv[0]);
+         return 2;
+      }
+   }
+   clientCount = (clientCount < 2) ? 2 : (clientCount > MAX_CLIENTS) ? MAX_CLIENTS : clientCount;
+   if (fps < 1) {
+      fps = 1;
+   }
+
+   initBitboards();
+   initZobrist();
+   memset(&stats, 0, sizeof(stats));
+   for (int i = 0; i < clientCount; i++) {
+      clients[i].game.moveCache = NULL;
+      clients[i].random = i + 1;
+      connectClient(i);
+   }
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   std::chrono::steady_clock::time_point end = start + std::chrono::microseconds((u64)(seconds * 1e6));
+   std::chrono::steady_clock::time_point frame = start;
+   u64 frames = 0;
+   while (frame < end) {
+      for (int i = 0; i < clientCount; i++) {
+         NetEvent event;
+         while (popNetEvent(netClients[i].inbound, event) && handleEvent(i, event)) {}
+         playTurn(i);
+      }
+      frames++;
+      frame += std::chrono::microseconds(1000000 / fps);
+      std::this_thread::sleep_until(frame);
+   }
+   double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   for (int i = 0; i < clientCount; i++) {
+      stopNetClient(netClients[i]);
+      addQueue(stats.inbound, netClients[i].inbound);
+      addQueue(stats.outbound, netClients[i].outbound);
+   }
+
+   printf("%d clients, %.1fs, %llu frames at %d fps\n", clientCount, elapsed, (unsigned long long)frames, fps);
+   printf("moves     %llu sent, %llu received\n", (unsigned long long)stats.movesSent,
+      (unsigned long long)stats.movesReceived);
+   // Both players hear of every game over.
+   printf("games     %llu finished, %llu abandoned after %u plies, %llu connections failed\n",
+      (unsigned long long)stats.finished / 2, (unsigned long long)stats.abandoned, maxPlies,
+      (unsigned long long)stats.failed);
+   printQueue("inbound", stats.inbound);
+   printQueue("outbound", stats.outbound);
+   return 0;
+}
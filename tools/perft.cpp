@@ -0,0 +1,163 @@
+// Counts the leaf nodes of the legal move tree and compares them with known results.
+//
+// perft                       runs the standard test positions, after checking loadFen() turns down or corrects
+//                             positions that can't come up in a game
+// perft -d <depth>            same, with every position searched to the given depth
+// perft -d <depth> -f <fen>   one position, printing the count below each root move
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "engine/movegen.h"
+#include "engine/fen.h"
+
+struct PerftPosition {
+   const char* name;
+   const char* fen;
+   // Known leaf counts for depths 1 to 6
+   u64 nodes[6];
+   u8 defaultDepth;
+};
+
+// From the Chess Programming Wiki perft results page.
+const PerftPosition POSITIONS[] = {
+   { "start", START_FEN,
+      { 20, 400, 8902, 197281, 4865609, 119060324 }, 6 },
+   { "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      { 48, 2039, 97862, 4085603, 193690690, 8031647685ULL }, 5 },
+   { "position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      { 14, 191, 2812, 43238, 674624, 11030083 }, 6 },
+   { "position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      { 6, 264, 9467, 422333, 15833292, 706045033 }, 5 },
+   { "position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      { 44, 1486, 62379, 2103487, 89941194, 3048196529ULL }, 5 },
+   { "position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      { 46, 2079, 89890, 3894594, 164075551, 6923051137ULL }, 5 }
+};
+
+// Positions loadFen() has to turn down or correct, with the legal moves left once it's loaded, -1 if it isn't
+struct FenCheck {
+   const char* fen;
+   int moves;
+};
+
+const FenCheck FEN_CHECKS[] = {
+   // Castling rights without their rook, or with the king elsewhere, are dropped.
+   { "4k3/8/8/8/8/8/8/4K3 w K - 0 1", 5 },
+   { "4k3/8/8/8/8/8/8/K7 w Q - 0 1", 3 },
+   // Pawns on the first or last row
+   { "P3k3/8/8/8/8/8/8/4K3 w - - 0 1", -1 },
+   { "4k3/8/8/8/8/8/8/p3K3 b - - 0 1", -1 },
+   // The side that just moved is in check
+   { "4k3/8/8/8/8/8/8/4RK2 w - - 0 1", -1 }
+};
+
+u64 perft(Board &board, u8 depth) {
+   MoveList moveList;
+   calculateLegalMoves(board, moveList);
+   // The last ply only needs counting.
+   if (depth == 1) {
+      return moveList.size;
+   }
+
+   u64 nodes = 0;
+   Undo undo;
+   for (u16 i = 0; i < moveList.size; i++) {
+      makeMove(board, moveList.moves[i], undo);
+      nodes += perft(board, depth - 1);
+      unmakeMove(board, moveList.moves[i], undo);
+   }
+   return nodes;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void divide(Board &board, u8 depth) {
+   MoveList moveList;
+   calculateLegalMoves(board, moveList);
+
+   u64 total = 0;
+   Undo undo;
+   char text[6];
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (u16 i = 0; i < moveList.size; i++) {
+      makeMove(board, moveList.moves[i], undo);
+      u64 nodes = (depth > 1) ? perft(board, depth - 1) : 1;
+      unmakeMove(board, moveList.moves[i], undo);
+      printf("%s: %llu\n", moveToString(moveList.moves[i], text), (unsigned long long)nodes);
+      total += nodes;
+   }
+   double seconds = secondsSince(start);
+   printf("\nnodes %llu  time %.3fs  nps %.0f\n", (unsigned long long)total, seconds, total / seconds);
+}
+
+int main(int argc, char* argv[]) {
+   int depth = 0;
+   const char* fen = NULL;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+         depth = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+         fen = argv[++i];
+      }
+      else {
+         fprintf(stderr, "usage: %s [-d depth] [-f fen]\n", argv[0]);
+         return 2;
+      }
+   }
+
+   initBitboards();
+   initZobrist();
+   Board board;
+
+   if (fen) {
+      if (!loadFen(board, fen)) {
+         fprintf(stderr, "invalid fen: %s\n", fen);
+         return 2;
+      }
+      divide(board, (depth > 0) ? depth : 1);
+      return 0;
+   }
+
+   bool failed = false;
+   for (size_t i = 0; i < sizeof(FEN_CHECKS) / sizeof(FEN_CHECKS[0]); i++) {
+      int moves = -1;
+      if (loadFen(board, FEN_CHECKS[i].fen)) {
+         MoveList moveList;
+         calculateLegalMoves(board, moveList);
+         moves = moveList.size;
+      }
+      if (moves != FEN_CHECKS[i].moves) {
+         printf("fen %s: %d moves, expected %d  FAIL\n", FEN_CHECKS[i].fen, moves, FEN_CHECKS[i].moves);
+         failed = true;
+      }
+   }
+
+   u64 totalNodes = 0;
+   double totalSeconds = 0;
+   for (size_t p = 0; p < sizeof(POSITIONS) / sizeof(POSITIONS[0]); p++) {
+      const PerftPosition &position = POSITIONS[p];
+      u8 positionDepth = (depth > 0) ? depth : position.defaultDepth;
+      loadFen(board, position.fen);
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      u64 nodes = perft(board, positionDepth);
+      double seconds = secondsSince(start);
+      totalNodes += nodes;
+      totalSeconds += seconds;
+
+      u64 expected = (positionDepth <= 6) ? position.nodes[positionDepth - 1] : 0;
+      const char* status = (!expected) ? "?" : (nodes == expected) ? "ok" : "FAIL";
+      if (expected && nodes != expected) {
+         failed = true;
+      }
+      printf("%-10s depth %d  nodes %12llu  time %7.3fs  nps %11.0f  %s\n", position.name, positionDepth,
+         (unsigned long long)nodes, seconds, nodes / seconds, status);
+   }
+   printf("total                nodes %12llu  time %7.3fs  nps %11.0f\n", (unsigned long long)totalNodes, totalSeconds, totalNodes / totalSeconds);
+   return failed ? 1 : 0;
+}
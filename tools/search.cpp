@@ -0,0 +1,205 @@
+// Runs the engine's search with a fixed node count, so runs can be compared move for move.
+//
+// search                        the test positions, DEFAULT_NODES each
+// search -n <nodes>             same, with a different node count
+// search -d <depth>             same, stopping at the given depth instead
+// search -f <fen> [-n | -d]     one position
+// search -H <megabytes>         transposition table size, 0 for none
+// search -T <directory>         tablebases made by the tablebase tool
+// search -t <threads>           Lazy SMP with the given number of threads. The node count only limits the
+//                               main thread, so results vary from run to run.
+// search -s [-d depth]          scaling: every position to SCALING_DEPTH (or -d) with 1, 2, 4, 8 and as many
+//                               threads as the machine has, reporting time to depth and nodes per second
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#include "engine/parallel.h"
+#include "engine/fen.h"
+
+#define DEFAULT_NODES 2000000
+#define DEFAULT_TABLE_MB 64
+#define SCALING_DEPTH 8
+
+const char* const POSITIONS[] = {
+   START_FEN,
+   "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+   "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+   "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+   "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+   "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"
+};
+const u8 POSITION_COUNT = sizeof(POSITIONS) / sizeof(POSITIONS[0]);
+
+ParallelSearch parallel;
+TranspositionTable table;
+bool useTable = false;
+TablebaseSet tablebases;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Searches the position and returns the nodes searched. With verbose, prints a line per completed iteration
+// and the table statistics.
+u64 run(const Board &board, u8 depth, u64 nodes, bool verbose, double &seconds) {
+   PositionHistory history;
+   clearHistory(history);
+   pushPosition(history, board.key);
+   startParallelSearch(parallel, board, history, depth, nodes);
+   Search &search = mainSearch(parallel);
+
+   char text[6];
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   u8 reported = 0;
+   bool finished = false;
+   while (!finished) {
+      finished = continueParallelSearch(parallel, 4096);
+      if (verbose && search.completedDepth != reported) {
+         reported = search.completedDepth;
+         double elapsed = secondsSince(start);
+         u64 total = parallelNodes(parallel);
+         printf("depth %2d  score %6d  nodes %10llu  time %7.3fs  nps %9.0f  best %s\n", reported, search.score,
+            (unsigned long long)total, elapsed, total / elapsed, moveToString(search.bestMove, text));
+      }
+   }
+   seconds = secondsSince(start);
+   u64 total = parallelNodes(parallel);
+   if (!verbose) {
+      return total;
+   }
+
+   printf("bestmove %s  nodes %llu\n", search.bestMove ? moveToString(search.bestMove, text) : "none", (unsigned long long)total);
+   if (useTable) {
+      TableStats stats = parallelTableStats(parallel);
+      printf("table  probes %llu  hits %llu (%.1f%%)  collisions %llu  stores %llu  replacements %llu  fill %d/1000\n",
+         (unsigned long long)stats.probes, (unsigned long long)stats.hits, stats.probes ? 100.0 * stats.hits / stats.probes : 0.0,
+         (unsigned long long)stats.collisions, (unsigned long long)stats.stores, (unsigned long long)stats.replacements, tableFill(table));
+   }
+   if (tablebases.count) {
+      printf("tablebase hits %llu\n", (unsigned long long)parallelTablebaseHits(parallel));
+   }
+   printf("\n");
+   return total;
+}
+
+// Every test position to the depth with a fresh table, for each thread count.
+void scaling(u8 depth) {
+   u8 threadCounts[8];
+   u8 countCount = 0;
+   unsigned cores = std::thread::hardware_concurrency();
+   for (u8 threads = 1; threads <= 8; threads *= 2) {
+      threadCounts[countCount++] = threads;
+   }
+   if (cores > 8) {
+      threadCounts[countCount++] = (cores < MAX_THREADS) ? cores : MAX_THREADS;
+   }
+
+   printf("%u hardware threads, depth %d\n\n%7s %12s %14s %12s %9s\n", cores, depth, "threads", "time", "nodes", "nps", "speedup");
+   double baseline = 0;
+   for (u8 c = 0; c < countCount; c++) {
+      freeParallelSearch(parallel);
+      initParallelSearch(parallel, threadCounts[c], useTable ? &table : NULL);
+      setParallelTablebases(parallel, &tablebases);
+      double totalSeconds = 0;
+      u64 totalNodes = 0;
+      for (u8 p = 0; p < POSITION_COUNT; p++) {
+         Board board;
+         loadFen(board, POSITIONS[p]);
+         if (useTable) {
+            clearTable(table);
+         }
+         double seconds;
+         totalNodes += run(board, depth, 0, false, seconds);
+         totalSeconds += seconds;
+      }
+      if (!c) {
+         baseline = totalSeconds;
+      }
+      printf("%7d %11.3fs %14llu %12.0f %8.2fx\n", threadCounts[c], totalSeconds, (unsigned long long)totalNodes,
+         totalNodes / totalSeconds, baseline / totalSeconds);
+   }
+}
+
+int main(int argc, char* argv[]) {
+   int depth = 0;
+   long long nodes = 0;
+   int tableMegabytes = DEFAULT_TABLE_MB;
+   int threads = 1;
+   bool scale = false;
+   const char* fen = NULL;
+   const char* tablebaseDirectory = NULL;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+         depth = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+         nodes = atoll(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+         fen = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-H") && i + 1 < argc) {
+         tableMegabytes = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         threads = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-T") && i + 1 < argc) {
+         tablebaseDirectory = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-s")) {
+         scale = true;
+      }
+      else {
+         fprintf(stderr, "usage: %s [-n nodes] [-d depth] [-f fen] [-H megabytes] [-T directory] [-t threads] [-s]\n", argv[0]);
+         return 2;
+      }
+   }
+
+   initBitboards();
+   initZobrist();
+   if (tableMegabytes > 0) {
+      if (!initTable(table, tableMegabytes)) {
+         fprintf(stderr, "can't allocate a %d MB table\n", tableMegabytes);
+         return 1;
+      }
+      useTable = true;
+      printf("table  %llu buckets, %llu bytes\n\n", (unsigned long long)table.bucketCount, (unsigned long long)tableBytes(table));
+   }
+
+   if (tablebaseDirectory) {
+      printf("tablebases  %d loaded\n\n", loadTablebases(tablebases, tablebaseDirectory));
+   }
+
+   if (scale) {
+      scaling(depth ? depth : SCALING_DEPTH);
+      return 0;
+   }
+
+   if (!depth && !nodes) {
+      nodes = DEFAULT_NODES;
+   }
+   initParallelSearch(parallel, threads, useTable ? &table : NULL);
+   setParallelTablebases(parallel, &tablebases);
+
+   u64 totalNodes = 0;
+   double totalSeconds = 0;
+   u8 count = fen ? 1 : POSITION_COUNT;
+   for (u8 p = 0; p < count; p++) {
+      const char* position = fen ? fen : POSITIONS[p];
+      Board board;
+      if (!loadFen(board, position)) {
+         fprintf(stderr, "invalid fen: %s\n", position);
+         return 2;
+      }
+      printf("%s\n", position);
+      double seconds;
+      totalNodes += run(board, depth, nodes, true, seconds);
+      totalSeconds += seconds;
+   }
+   printf("total  nodes %llu  time %.3fs  nps %.0f\n", (unsigned long long)totalNodes, totalSeconds, totalNodes / totalSeconds);
+   return 0;
+}
@@ -0,0 +1,565 @@
+// Match server for the 3DS application's online mode, and the reference for its protocol (engine/protocol.h).
+//
+// server [-p port] [-t shards] [-s seconds]
+//
+// Clients say hello and are paired in the order they do, the first one as white. Both get the game start with
+// their color and the turn, then every move is relayed to the opponent. The server plays the moves on its own
+// Game as it relays them, which is how it knows whether a move is legal and when the game is over: checkmate,
+// stalemate and threefold repetition end it with a game over to both sides, and so does either side leaving or
+// sending something that isn't a frame. A move the rules don't allow isn't passed on; the game ends with an
+// illegal move game over naming the side that sent it. Pings are read and dropped. Clients of another protocol
+// version are told so and let go: version 1 ones with the game over they understand, unframed.
+//
+// Every shard is an epoll loop on its own thread with its own SO_REUSEPORT listener, so the kernel spreads the
+// connections over them and clients are only paired with others on the same shard. Each client has a ring
+// buffer for what it sent and one for what it's sent. Every frame that's complete after a read is handled, and
+// what they produce goes out once the loop has been through all the events, one send per client. Nothing is
+// allocated per message; a finished match's Game is reused by the next one. It runs until killed, or for -s
+// seconds, and prints the clients, games and moves every STATS_SECONDS.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "engine/game.h"
+#include "engine/protocol.h"
+
+#define MAX_SHARDS 64
+#define LISTEN_BACKLOG 4096
+#define EVENTS_PER_WAIT 256
+// Longest an epoll wait lasts, and so how long stopping takes
+#define WAIT_MS 100
+#define STATS_SECONDS 10
+#define NO_MATCH 0xFFFFFFFF
+
+enum ClientState : u8 {
+   CLIENT_FREE,
+   // Connected, no hello yet
+   CLIENT_CONNECTED,
+   CLIENT_WAITING,
+   CLIENT_PLAYING,
+   // Its game is over. Our side of the connection is shut down once the output is sent, and whatever it still
+   // sends is dropped until it closes too, so closing doesn't reset the connection before the game over arrives.
+   CLIENT_CLOSING
+};
+
+struct Client {
+   ClientState state;
+   Color color;
+   // In the shard's list of clients to send to
+   bool queued;
+   // The socket buffer was full, so the rest of the output waits for EPOLLOUT
+   bool blocked;
+   u32 match;
+   RingBuffer input;
+   RingBuffer output;
+};
+
+struct Match {
+   Game game;
+   // Sockets of the players, by color
+   int fds[2];
+   // Next free match, while this one is free
+   u32 nextFree;
+};
+
+// Written by the shard's thread, read by the main thread with atomic operations
+struct ShardStats {
+   u64 clients;
+   u64 games;
+   u64 finished;
+   u64 moves;
+   u64 rejected;
+   u64 outdated;
+};
+
+struct Shard {
+   int listener;
+   int epoll;
+   // By socket
+   std::vector<Client> clients;
+   std::vector<Match> matches;
+   u32 freeMatch;
+   // Socket of the client waiting for an opponent, or -1
+   int waiting;
+   // Clients with output queued since the last send
+   std::vector<int> toSend;
+   ShardStats stats;
+};
+
+Shard shards[MAX_SHARDS];
+bool stopRequested = false;
+
+inline void count(u64 &counter, s64 change) {
+   __atomic_add_fetch(&counter, change, __ATOMIC_RELAXED);
+}
+
+// Queues the bytes to go out with the next send to the client. Returns false if its output is full, which with
+// messages this small means it stopped reading.
+bool queueBytes(Shard &shard, int fd, const u8* bytes, u8 length, bool framed = true) {
+   Client &client = shard.clients[fd];
+   if (!(framed ? writeFrame(client.output, bytes, length) : ringWrite(client.output, bytes, length))) {
+      return false;
+   }
+   if (!client.queued) {
+      client.queued = true;
+      shard.toSend.push_back(fd);
+   }
+   return true;
+}
+
+void watchOutput(Shard &shard, int fd, bool output) {
+   epoll_event event;
+   event.events = output ? EPOLLIN | EPOLLOUT : EPOLLIN;
+   event.data.fd = fd;
+   epoll_ctl(shard.epoll, EPOLL_CTL_MOD, fd, &event);
+   shard.clients[fd].blocked = output;
+}
+
+void closeClient(Shard &shard, int fd) {
+   if (shard.waiting == fd) {
+      shard.waiting = -1;
+   }
+   shard.clients[fd].state = CLIENT_FREE;
+   close(fd);
+   count(shard.stats.clients, -1);
+}
+
+// Stops reading from the client, and lets it go once what's queued for it is sent.
+void finishClient(Shard &shard, int fd) {
+   if (shard.waiting == fd) {
+      shard.waiting = -1;
+   }
+   Client &client = shard.clients[fd];
+   client.state = CLIENT_CLOSING;
+   client.match = NO_MATCH;
+   if (!client.queued) {
+      client.queued = true;
+      shard.toSend.push_back(fd);
+   }
+}
+
+// Tells both players the game is over and frees the match. The color is the winner's, or the offender's for
+// an illegal move. The leaver, if there is one, is closed at once.
+void endMatch(Shard &shard, u32 index, GameOverReason reason, Color color, int leaver = -1) {
+   u8 message[3] = { MESSAGE_GAME_OVER, reason, color };
+   for (u8 color = white; color <= black; color++) {
+      int fd = shard.matches[index].fds[color];
+      if (fd == leaver) {
+         closeClient(shard, fd);
+         continue;
+      }
+      queueBytes(shard, fd, message, (reason == GAME_OVER_WIN || reason == GAME_OVER_ILLEGAL_MOVE) ? 3 : 2);
+      finishClient(shard, fd);
+   }
+   shard.matches[index].nextFree = shard.freeMatch;
+   shard.freeMatch = index;
+   count(shard.stats.finished, 1);
+}
+
+void startMatch(Shard &shard, int whiteFd, int blackFd) {
+   u32 index = shard.freeMatch;
+   if (index != NO_MATCH) {
+      shard.freeMatch = shard.matches[index].nextFree;
+   }
+   else {
+      index = shard.matches.size();
+      shard.matches.push_back(Match());
+   }
+   Match &match = shard.matches[index];
+   match.game.moveCache = NULL;
+   setupGame(match.game);
+   calculateAllMoves(match.game);
+   match.fds[white] = whiteFd;
+   match.fds[black] = blackFd;
+   count(shard.stats.games, 1);
+
+   bool queued = true;
+   for (u8 color = white; color <= black; color++) {
+      Client &client = shard.clients[match.fds[color]];
+      client.state = CLIENT_PLAYING;
+      client.color = (Color)color;
+      client.match = index;
+      u8 start[2] = { MESSAGE_GAME_START, color };
+      u8 turn[2] = { MESSAGE_TURN, white };
+      queued = queued && queueBytes(shard, match.fds[color], start, 2) && queueBytes(shard, match.fds[color], turn, 2);
+   }
+   if (!queued) {
+      endMatch(shard, index, GAME_OVER_ERROR, white);
+   }
+}
+
+void handleHello(Shard &shard, int fd) {
+   if (shard.clients[fd].state != CLIENT_CONNECTED) {
+      return;
+   }
+   if (shard.waiting < 0) {
+      shard.waiting = fd;
+      shard.clients[fd].state = CLIENT_WAITING;
+      return;
+   }
+   int opponent = shard.waiting;
+   shard.waiting = -1;
+   startMatch(shard, opponent, fd);
+}
+
+// Plays the move on the match's game and passes it on, if it's the sender's turn and the rules allow it. The
+// server's game is the one that counts, so a client that fell out of step loses its game the same way as one
+// that cheats. allowedMove() only generates the moves of the piece moved, like on the 3DS, without allocating.
+void handleMove(Shard &shard, int fd, const u8* bytes, u8 length) {
+   Client &client = shard.clients[fd];
+   u32 index = client.match;
+   Game &game = shard.matches[index].game;
+   Move move = readMoveMessage(bytes, length, game.board);
+   if (game.board.turn != client.color || !allowedMove(game, move)) {
+      count(shard.stats.rejected, 1);
+      endMatch(shard, index, GAME_OVER_ILLEGAL_MOVE, client.color);
+      return;
+   }
+   movePiece(game, move);
+   count(shard.stats.moves, 1);
+   if (!queueBytes(shard, shard.matches[index].fds[!client.color], bytes, length)) {
+      endMatch(shard, index, GAME_OVER_ERROR, white);
+      return;
+   }
+   switch (game.end) {
+   case GAME_CHECKMATE:
+      endMatch(shard, index, GAME_OVER_WIN, (Color)!game.board.turn);
+      break;
+   case GAME_STALEMATE:
+   case GAME_REPETITION:
+      endMatch(shard, index, GAME_OVER_DRAW, white);
+      break;
+   default:
+      break;
+   }
+}
+
+// Answers a client that doesn't speak this version. Version 1 clients only read bare messages.
+void rejectVersion(Shard &shard, int fd) {
+   Client &client = shard.clients[fd];
+   if (ringByte(client.input, 0) == MESSAGE_HELLO) {
+      u8 message[2] = { MESSAGE_GAME_OVER, GAME_OVER_ERROR };
+      queueBytes(shard, fd, message, 2, false);
+   }
+   else {
+      u8 message[2] = { MESSAGE_GAME_OVER, GAME_OVER_VERSION };
+      queueBytes(shard, fd, message, 2);
+   }
+   count(shard.stats.outdated, 1);
+   finishClient(shard, fd);
+}
+
+// Handles every complete frame read from the client.
+void handleInput(Shard &shard, int fd) {
+   while (true) {
+      Client &client = shard.clients[fd];
+      if (client.state == CLIENT_CLOSING) {
+         ringRemoved(client.input, ringUsed(client.input));
+         return;
+      }
+      u8 message[MAX_MESSAGE];
+      u8 length;
+      FrameResult result = readFrame(client.input, message, length);
+      if (result == FRAME_INCOMPLETE) {
+         return;
+      }
+      bool playing = client.state == CLIENT_PLAYING;
+      if (result == FRAME_INVALID || (message[0] != MESSAGE_HELLO && message[0] != MESSAGE_PING
+         && (message[0] != MESSAGE_MOVE || !playing))) {
+         if (playing) {
+            endMatch(shard, client.match, GAME_OVER_ERROR, white, fd);
+         }
+         else if (result == FRAME_INVALID && ringByte(client.input, 0) != PROTOCOL_VERSION) {
+            rejectVersion(shard, fd);
+         }
+         else {
+            closeClient(shard, fd);
+         }
+         return;
+      }
+      if (message[0] == MESSAGE_HELLO) {
+         handleHello(shard, fd);
+      }
+      else if (message[0] == MESSAGE_MOVE) {
+         handleMove(shard, fd, message, length);
+      }
+   }
+}
+
+// Reads until the socket is drained, handling the frames as they complete.
+void readClient(Shard &shard, int fd) {
+   while (shard.clients[fd].state != CLIENT_FREE) {
+      Client &client = shard.clients[fd];
+      u32 space;
+      u8* into = ringSpace(client.input, space);
+      ssize_t bytes;
+      while ((bytes = recv(fd, into, space, 0)) == -1 && errno == EINTR);
+      if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         return;
+      }
+      if (bytes <= 0) {
+         if (client.state == CLIENT_PLAYING) {
+            endMatch(shard, client.match, GAME_OVER_ERROR, white, fd);
+         }
+         else {
+            closeClient(shard, fd);
+         }
+         return;
+      }
+      ringAdded(client.input, bytes);
+      handleInput(shard, fd);
+      if ((u32)bytes < space) {
+         return;
+      }
+   }
+}
+
+// Sends what's queued for the client, as much as the socket takes.
+void sendClient(Shard &shard, int fd) {
+   Client &client = shard.clients[fd];
+   while (ringUsed(client.output)) {
+      u32 size;
+      const u8* data = ringData(client.output, size);
+      ssize_t sent;
+      while ((sent = send(fd, data, size, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+      if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         if (!client.blocked) {
+            watchOutput(shard, fd, true);
+         }
+         return;
+      }
+      if (sent < 0) {
+         if (client.state == CLIENT_PLAYING) {
+            endMatch(shard, client.match, GAME_OVER_ERROR, white, fd);
+         }
+         else {
+            closeClient(shard, fd);
+         }
+         return;
+      }
+      ringRemoved(client.output, sent);
+   }
+   if (client.blocked) {
+      watchOutput(shard, fd, false);
+   }
+   if (client.state == CLIENT_CLOSING) {
+      shutdown(fd, SHUT_WR);
+   }
+}
+
+void acceptClients(Shard &shard) {
+   while (true) {
+      int fd = accept4(shard.listener, NULL, NULL, SOCK_NONBLOCK);
+      if (fd < 0) {
+         if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+         }
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("accept");
+         }
+         return;
+      }
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      if (epoll_ctl(shard.epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+         perror("epoll_ctl");
+         close(fd);
+         continue;
+      }
+      if ((size_t)fd >= shard.clients.size()) {
+         shard.clients.resize(fd + 1);
+      }
+      Client &client = shard.clients[fd];
+      client.state = CLIENT_CONNECTED;
+      client.queued = false;
+      client.blocked = false;
+      client.match = NO_MATCH;
+      clearRing(client.input);
+      clearRing(client.output);
+      count(shard.stats.clients, 1);
+   }
+}
+
+void runShard(Shard* shard) {
+   epoll_event events[EVENTS_PER_WAIT];
+   while (!__atomic_load_n(&stopRequested, __ATOMIC_RELAXED)) {
+      int ready = epoll_wait(shard->epoll, events, EVENTS_PER_WAIT, WAIT_MS);
+      for (int i = 0; i < ready; i++) {
+         int fd = events[i].data.fd;
+         if (fd == shard->listener) {
+            acceptClients(*shard);
+            continue;
+         }
+         // An earlier event of the batch may have closed it
+         if (shard->clients[fd].state != CLIENT_FREE && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            readClient(*shard, fd);
+         }
+         if (shard->clients[fd].state != CLIENT_FREE && (events[i].events & EPOLLOUT)) {
+            sendClient(*shard, fd);
+         }
+      }
+      // Everything the events produced for a client goes out together.
+      for (size_t i = 0; i < shard->toSend.size(); i++) {
+         int fd = shard->toSend[i];
+         shard->clients[fd].queued = false;
+         if (shard->clients[fd].state != CLIENT_FREE && !shard->clients[fd].blocked) {
+            sendClient(*shard, fd);
+         }
+      }
+      shard->toSend.clear();
+   }
+   for (size_t fd = 0; fd < shard->clients.size(); fd++) {
+      if (shard->clients[fd].state != CLIENT_FREE) {
+         close(fd);
+      }
+   }
+   close(shard->listener);
+   close(shard->epoll);
+}
+
+int openListener(u16 port) {
+   int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+   if (fd < 0) {
+      return -1;
+   }
+   int on = 1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+   setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+   sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_ANY);
+   address.sin_port = htons(port);
+   if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(fd, LISTEN_BACKLOG) < 0) {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+// Thousands of clients need more sockets than the usual default allows.
+void raiseFileLimit() {
+   rlimit limit;
+   if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max) {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+   }
+}
+
+void printStats(u8 shardCount, double seconds, u64 previousMoves) {
+   u64 clients = 0, games = 0, finished = 0, moves = 0, rejected = 0, outdated = 0;
+   for (u8 i = 0; i < shardCount; i++) {
+      clients += __atomic_load_n(&shards[i].stats.clients, __ATOMIC_RELAXED);
+      games += __atomic_load_n(&shards[i].stats.games, __ATOMIC_RELAXED);
+      finished += __atomic_load_n(&shards[i].stats.finished, __ATOMIC_RELAXED);
+      moves += __atomic_load_n(&shards[i].stats.moves, __ATOMIC_RELAXED);
+      rejected += __atomic_load_n(&shards[i].stats.rejected, __ATOMIC_RELAXED);
+      outdated += __atomic_load_n(&shards[i].stats.outdated, __ATOMIC_RELAXED);
+   }
+   printf("%.0fs: %llu clients, %llu games playing, %llu finished, %llu moves (%.0f/s), %llu rejected, "
+      "%llu of another version\n", seconds, (unsigned long long)clients, (unsigned long long)(games - finished),
+      (unsigned long long)finished, (unsigned long long)moves, (moves - previousMoves) / (double)STATS_SECONDS,
+      (unsigned long long)rejected, (unsigned long long)outdated);
+}
+
+u64 totalMoves(u8 shardCount) {
+   u64 moves = 0;
+   for (u8 i = 0; i < shardCount; i++) {
+      moves += __atomic_load_n(&shards[i].stats.moves, __ATOMIC_RELAXED);
+   }
+   return moves;
+}
+
+u64 totalRejected(u8 shardCount) {
+   u64 rejected = 0;
+   for (u8 i = 0; i < shardCount; i++) {
+      rejected += __atomic_load_n(&shards[i].stats.rejected, __ATOMIC_RELAXED);
+   }
+   return rejected;
+}
+
+int main(int argc, char* argv[]) {
+   int port = PROTOCOL_PORT;
+   int shardCount = 1;
+   double seconds = 0;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+         port = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         shardCount = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+         seconds = atof(argv[++i]);
+      }
+      else {
+         fprintf(stderr, "usage: %s [-p port] [-t shards] [-s seconds]\n", argv[0]);
+         return 2;
+      }
+   }
+   shardCount = (shardCount < 1) ? 1 : (shardCount > MAX_SHARDS) ? MAX_SHARDS : shardCount;
+
+   setvbuf(stdout, NULL, _IOLBF, 0);
+   initBitboards();
+   initZobrist();
+   raiseFileLimit();
+   for (int i = 0; i < shardCount; i++) {
+      Shard &shard = shards[i];
+      shard.listener = openListener(port);
+      shard.epoll = epoll_create1(0);
+      if (shard.listener < 0 || shard.epoll < 0) {
+         fprintf(stderr, "can't listen on port %d: %s\n", port, strerror(errno));
+         return 1;
+      }
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = shard.listener;
+      epoll_ctl(shard.epoll, EPOLL_CTL_ADD, shard.listener, &event);
+      shard.freeMatch = NO_MATCH;
+      shard.waiting = -1;
+      shard.toSend.reserve(EVENTS_PER_WAIT * 2);
+      memset(&shard.stats, 0, sizeof(shard.stats));
+   }
+   printf("listening on port %d with %d shards\n", port, shardCount);
+
+   std::thread threads[MAX_SHARDS];
+   for (int i = 0; i < shardCount; i++) {
+      threads[i] = std::thread(runShard, &shards[i]);
+   }
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   double elapsed = 0;
+   double nextStats = STATS_SECONDS;
+   u64 previousMoves = 0;
+   while (!seconds || elapsed < seconds) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_MS));
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (elapsed >= nextStats) {
+         printStats(shardCount, elapsed, previousMoves);
+         previousMoves = totalMoves(shardCount);
+         nextStats += STATS_SECONDS;
+      }
+   }
+   __atomic_store_n(&stopRequested, true, __ATOMIC_RELAXED);
+   for (int i = 0; i < shardCount; i++) {
+      threads[i].join();
+   }
+   u64 moves = totalMoves(shardCount);
+   printf("%llu moves in %.1fs: %.0f moves/s, %llu illegal moves rejected\n", (unsigned long long)moves, elapsed,
+      moves / elapsed, (unsigned long long)totalRejected(shardCount));
+   return 0;
+}
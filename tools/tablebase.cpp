@@ -0,0 +1,566 @@
+// Generates endgame tablebases by retrograde analysis, and looks positions up in them.
+//
+// tablebase [-o directory] [-t threads] [name...]
+//                      the named tables (KQKR) and every smaller one they turn into after a capture or
+//                      promotion, or every three piece table if none are named. Tables already in the
+//                      directory are used instead of being generated again.
+// tablebase -o directory -f fen
+//                      the position's result and the line both sides play from it
+//
+// Generation works outwards from the mates. Pass n finds the positions n plies from mate: a win if a move
+// reaches a position lost in n - 1, a loss if every move reaches a position won in at most n - 1. Only the
+// positions that can have changed are looked at again: those a position of the last pass can be reached from,
+// found by taking a move back, and those with a capture or promotion into a smaller table whose distance
+// makes this their pass. Each pass is split across the threads, which only ever trust values from earlier
+// passes, so the result is the same whatever order they get through the positions in.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "engine/tablebase.h"
+#include "engine/fen.h"
+
+#define DEFAULT_DIRECTORY "tablebases"
+// Positions a thread takes at a time
+#define CHUNK_SIZE 4096
+
+TablebaseSet tablebases;
+// [table], the values of the tables generated in this run
+std::vector<u8> generated[MAX_TABLEBASES];
+const char* directory = DEFAULT_DIRECTORY;
+u8 threadCount = 1;
+// [pawns][class], inverse of tablebaseKingClass()
+u8 kingSquares[2][32];
+// The table being generated
+const Tablebase* current;
+
+// What the passes of the table being generated share
+struct Generation {
+   Tablebase* tablebase;
+   u8* values;
+   // Bit per position, to be looked at in this pass and the next
+   std::vector<u64> dirty;
+   std::vector<u64> nextDirty;
+   // Positions with a pawn move that allows en passant. The position after it isn't in the table, so they're
+   // looked at in every pass.
+   std::vector<u64> always;
+   // [position], the passes a capture or promotion can decide the position in: one for winning, one for losing
+   std::vector<u8> winPass;
+   std::vector<u8> lossPass;
+   u32 next;
+   u32 resolved;
+};
+
+inline bool testBit(const std::vector<u64> &bits, u32 index) {
+   return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+inline void setBit(std::vector<u64> &bits, u32 index) {
+   __atomic_fetch_or(&bits[index / 64], (u64)1 << (index % 64), __ATOMIC_RELAXED);
+}
+
+// Sets up the position at the index. Returns false if it can't come up in a game or is looked up through
+// another index.
+bool decodePosition(const Tablebase &tablebase, u32 index, Board &board) {
+   const TablebaseMaterial &material = tablebase.material;
+   u8 squares[TABLEBASE_MAX_PIECES];
+   u8 count = 2 + material.counts[0] + material.counts[1];
+   u32 rest = index;
+   for (u8 i = count; i-- > 1;) {
+      squares[i] = rest % 64;
+      rest /= 64;
+   }
+   squares[0] = kingSquares[tablebase.pawns][rest % tablebaseKingClasses(tablebase.pawns)];
+   u8 turn = rest / tablebaseKingClasses(tablebase.pawns);
+
+   memset(&board, 0, sizeof(board));
+   board.enPassant = -1;
+   board.turn = (Color)turn;
+   Bitboard used = 0;
+   for (u8 i = 0; i < count; i++) {
+      if (used & BIT(squares[i])) {
+         return false;
+      }
+      used |= BIT(squares[i]);
+   }
+   putPiece(board, white, king, squares[0]);
+   putPiece(board, black, king, squares[1]);
+   for (u8 s = 0, n = 2; s < 2; s++) {
+      for (u8 i = 0; i < material.counts[s]; i++, n++) {
+         Piece piece = material.pieces[s][i];
+         if (piece == pawn && (squares[n] < 8 || squares[n] >= 56)) {
+            return false;
+         }
+         putPiece(board, (Color)s, piece, squares[n]);
+      }
+   }
+   return !squareAttacked(board, kingSquare(board, (Color)!turn), (Color)turn) && tablebaseIndex(tablebase, squares, turn) == index;
+}
+
+inline u8 lookUp(const Board &board) {
+   if (popCount(board.occupied) == 2) {
+      return TABLEBASE_DRAW;
+   }
+   bool swap;
+   const Tablebase* tablebase = findTablebase(tablebases, board, swap);
+   return tablebaseValue(*tablebase, boardTablebaseIndex(*tablebase, board, swap));
+}
+
+u8 evaluatePosition(Board &board, u8 limit);
+
+// Value of the position after a move, counting values above the limit as unknown. A position that allows en
+// passant isn't in any table, so it's worked out from its own moves. Without a capture or promotion the
+// position is in the table being generated, with the stronger side still white.
+u8 successorValue(Board &after, bool converted, u8 limit) {
+   if (after.enPassant >= 0) {
+      return limit ? evaluatePosition(after, limit - 1) : TABLEBASE_DRAW;
+   }
+   u8 value = converted ? lookUp(after) : tablebaseValue(*current, boardTablebaseIndex(*current, after, false));
+   return (value <= limit) ? value : TABLEBASE_DRAW;
+}
+
+// Value of the position from its moves, only trusting values up to the limit. TABLEBASE_DRAW if that isn't
+// enough to tell.
+u8 evaluatePosition(Board &board, u8 limit) {
+   MoveList moves;
+   calculateLegalMoves(board, moves);
+   if (!moves.size) {
+      return inCheck(board) ? 1 : TABLEBASE_DRAW;
+   }
+   u8 bestWin = TABLEBASE_INVALID;
+   u8 longestLoss = 0;
+   bool allLost = true;
+   for (u16 i = 0; i < moves.size; i++) {
+      Board after = board;
+      Undo undo;
+      makeMove(after, moves.moves[i], undo);
+      u8 value = successorValue(after, undo.captured || moveFlag(moves.moves[i]) == MOVE_PROMOTION, limit);
+      if (value != TABLEBASE_DRAW && (value & 1)) {
+         if (value + 1 < bestWin) {
+            bestWin = value + 1;
+         }
+      }
+      else if (value != TABLEBASE_DRAW && value + 1 < TABLEBASE_INVALID) {
+         if (value + 1 > longestLoss) {
+            longestLoss = value + 1;
+         }
+      }
+      else {
+         allLost = false;
+      }
+   }
+   if (bestWin != TABLEBASE_INVALID) {
+      return bestWin;
+   }
+   return allLost ? longestLoss : TABLEBASE_DRAW;
+}
+
+// Marks the positions a move back from the resolved one for the next pass. Captures and promotions lead here
+// from other tables, so only plain moves are taken back.
+void markPredecessors(Generation &generation, const Board &board) {
+   const Tablebase &tablebase = *generation.tablebase;
+   Color mover = (Color)!board.turn;
+   Bitboard pieces = board.colors[mover];
+   while (pieces) {
+      u8 to = popLowestSquare(pieces);
+      Piece piece = pieceOn(board, to);
+      Bitboard origins = 0;
+      switch (piece) {
+      case pawn:
+         if (mover == white && to >= 16 && !(board.occupied & BIT(to - 8))) {
+            origins = BIT(to - 8) | ((to / 8 == 3 && !(board.occupied & BIT(to - 16))) ? BIT(to - 16) : 0);
+         }
+         else if (mover == black && to < 48 && !(board.occupied & BIT(to + 8))) {
+            origins = BIT(to + 8) | ((to / 8 == 4 && !(board.occupied & BIT(to + 16))) ? BIT(to + 16) : 0);
+         }
+         break;
+      case king:
+         origins = kingAttacks[to] & ~board.occupied;
+         break;
+      case knight:
+         origins = knightAttacks[to] & ~board.occupied;
+         break;
+      case bishop:
+         origins = bishopAttacks(to, board.occupied) & ~board.occupied;
+         break;
+      case rook:
+         origins = rookAttacks(to, board.occupied) & ~board.occupied;
+         break;
+      default:
+         origins = queenAttacks(to, board.occupied) & ~board.occupied;
+         break;
+      }
+      while (origins) {
+         u8 from = popLowestSquare(origins);
+         Board before = board;
+         removePiece(before, mover, piece, to);
+         putPiece(before, mover, piece, from);
+         before.turn = mover;
+         // The table's own positions always have the stronger side as white.
+         u32 index = boardTablebaseIndex(tablebase, before, false);
+         if (__atomic_load_n(&generation.values[index], __ATOMIC_RELAXED) == TABLEBASE_DRAW) {
+            setBit(generation.nextDirty, index);
+         }
+      }
+   }
+}
+
+// Pass 0: marks the positions that can't come up and the mates, and finds the passes captures and promotions
+// decide the rest in.
+void firstPass(Generation &generation, u32 first, u32 last) {
+   const Tablebase &tablebase = *generation.tablebase;
+   for (u32 index = first; index < last; index++) {
+      Board board;
+      if (!decodePosition(tablebase, index, board)) {
+         generation.values[index] = TABLEBASE_INVALID;
+         continue;
+      }
+      MoveList moves;
+      calculateLegalMoves(board, moves);
+      if (!moves.size) {
+         if (inCheck(board)) {
+            generation.values[index] = 1;
+            __atomic_fetch_add(&generation.resolved, 1, __ATOMIC_RELAXED);
+            markPredecessors(generation, board);
+         }
+         continue;
+      }
+
+      u8 winPass = 0;
+      u8 lossPass = 0;
+      for (u16 i = 0; i < moves.size; i++) {
+         Board after = board;
+         Undo undo;
+         makeMove(after, moves.moves[i], undo);
+         if (after.enPassant >= 0) {
+            setBit(generation.always, index);
+         }
+         if (!undo.captured && moveFlag(moves.moves[i]) != MOVE_PROMOTION) {
+            continue;
+         }
+         u8 value = lookUp(after);
+         if (value != TABLEBASE_DRAW && (value & 1)) {
+            winPass = (!winPass || value < winPass) ? value : winPass;
+         }
+         else if (value != TABLEBASE_DRAW && value > lossPass) {
+            lossPass = value;
+         }
+      }
+      generation.winPass[index] = winPass;
+      generation.lossPass[index] = lossPass;
+   }
+}
+
+void nextPass(Generation &generation, u8 pass, u32 first, u32 last) {
+   const Tablebase &tablebase = *generation.tablebase;
+   for (u32 index = first; index < last; index++) {
+      if (generation.values[index] != TABLEBASE_DRAW || !(testBit(generation.dirty, index) || testBit(generation.always, index)
+         || generation.winPass[index] == pass || generation.lossPass[index] == pass)) {
+         continue;
+      }
+      Board board;
+      decodePosition(tablebase, index, board);
+      u8 value = evaluatePosition(board, pass);
+      if (value != TABLEBASE_DRAW) {
+         __atomic_store_n(&generation.values[index], value, __ATOMIC_RELAXED);
+         __atomic_fetch_add(&generation.resolved, 1, __ATOMIC_RELAXED);
+         markPredecessors(generation, board);
+      }
+   }
+}
+
+void worker(Generation* generation, u8 pass) {
+   u32 size = generation->tablebase->size;
+   while (true) {
+      u32 first = __atomic_fetch_add(&generation->next, CHUNK_SIZE, __ATOMIC_RELAXED);
+      if (first >= size) {
+         return;
+      }
+      u32 last = (first + CHUNK_SIZE < size) ? first + CHUNK_SIZE : size;
+      if (pass) {
+         nextPass(*generation, pass, first, last);
+      }
+      else {
+         firstPass(*generation, first, last);
+      }
+   }
+}
+
+// Runs the pass on every thread and returns how many positions it resolved.
+u32 runPass(Generation &generation, u8 pass) {
+   generation.next = 0;
+   generation.resolved = 0;
+   std::thread threads[256];
+   for (u8 i = 1; i < threadCount; i++) {
+      threads[i] = std::thread(worker, &generation, pass);
+   }
+   worker(&generation, pass);
+   for (u8 i = 1; i < threadCount; i++) {
+      threads[i].join();
+   }
+   return generation.resolved;
+}
+
+bool writeTablebase(const Tablebase &tablebase, const char* path) {
+   FILE* file = fopen(path, "wb");
+   if (!file) {
+      return false;
+   }
+   u8 header[TABLEBASE_HEADER_SIZE];
+   encodeTablebaseHeader(tablebase, header);
+   bool written = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(tablebase.values, tablebase.size, 1, file) == 1;
+   return (fclose(file) == 0) && written;
+}
+
+// Name of the table for the pieces besides the kings, given in any order for either side.
+void materialName(const Piece* a, u8 aCount, const Piece* b, u8 bCount, char (&name)[8]) {
+   TablebaseMaterial material;
+   memset(&material, 0, sizeof(material));
+   const Piece* sides[2] = { a, b };
+   u8 counts[2] = { aCount, bCount };
+   for (u8 s = 0; s < 2; s++) {
+      for (u8 o = 0; o < 5; o++) {
+         for (u8 i = 0; i < counts[s]; i++) {
+            if (sides[s][i] == TABLEBASE_ORDER[o]) {
+               material.pieces[s][material.counts[s]++] = sides[s][i];
+            }
+         }
+      }
+   }
+   if (strongerMaterial(material.pieces[1], material.counts[1], material.pieces[0], material.counts[0])) {
+      TablebaseMaterial swapped;
+      memcpy(swapped.pieces[0], material.pieces[1], sizeof(swapped.pieces[0]));
+      memcpy(swapped.pieces[1], material.pieces[0], sizeof(swapped.pieces[1]));
+      swapped.counts[0] = material.counts[1];
+      swapped.counts[1] = material.counts[0];
+      material = swapped;
+   }
+   tablebaseName(material, name);
+}
+
+bool generate(const char* name);
+
+// Every table a capture or promotion turns this one into
+bool generateSmaller(const TablebaseMaterial &material) {
+   for (u8 s = 0; s < 2; s++) {
+      for (u8 i = 0; i < material.counts[s]; i++) {
+         Piece left[TABLEBASE_MAX_EXTRA];
+         u8 leftCount = 0;
+         for (u8 k = 0; k < material.counts[s]; k++) {
+            if (k != i) {
+               left[leftCount++] = material.pieces[s][k];
+            }
+         }
+         char name[8];
+         if (leftCount + material.counts[!s]) {
+            materialName(left, leftCount, material.pieces[!s], material.counts[!s], name);
+            if (!generate(name)) {
+               return false;
+            }
+         }
+         if (material.pieces[s][i] != pawn) {
+            continue;
+         }
+         for (u8 o = 0; o < 4; o++) {
+            left[leftCount] = TABLEBASE_ORDER[o];
+            materialName(left, leftCount + 1, material.pieces[!s], material.counts[!s], name);
+            if (!generate(name)) {
+               return false;
+            }
+         }
+      }
+   }
+   return true;
+}
+
+bool generate(const char* name) {
+   Tablebase wanted;
+   if (!initTablebase(wanted, name)) {
+      fprintf(stderr, "not a table name: %s\n", name);
+      return false;
+   }
+   for (u8 i = 0; i < tablebases.count; i++) {
+      if (!memcmp(&tablebases.tables[i].material, &wanted.material, sizeof(wanted.material))) {
+         return true;
+      }
+   }
+   if (!generateSmaller(wanted.material)) {
+      return false;
+   }
+   Tablebase &slot = tablebases.tables[tablebases.count];
+   slot = wanted;
+
+   char path[256];
+   snprintf(path, sizeof(path), "%s/%s.tb", directory, name);
+   if (openTablebase(slot, path)) {
+      tablebases.count++;
+      printf("%-6s loaded from %s\n", name, path);
+      return true;
+   }
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   u8 table = tablebases.count;
+   generated[table].assign(slot.size, TABLEBASE_DRAW);
+   slot.values = generated[table].data();
+   tablebases.count++;
+
+   current = &slot;
+   Generation generation;
+   generation.tablebase = &slot;
+   generation.values = generated[table].data();
+   u32 words = (slot.size + 63) / 64;
+   generation.dirty.assign(words, 0);
+   generation.nextDirty.assign(words, 0);
+   generation.always.assign(words, 0);
+   generation.winPass.assign(slot.size, 0);
+   generation.lossPass.assign(slot.size, 0);
+
+   u32 resolved = runPass(generation, 0);
+   u8 lastDecided = 0;
+   for (u32 i = 0; i < slot.size; i++) {
+      lastDecided = std::max(lastDecided, std::max(generation.winPass[i], generation.lossPass[i]));
+   }
+   u32 previous = resolved;
+   u8 pass = 1;
+   for (; pass < TABLEBASE_INVALID - 1; pass++) {
+      generation.dirty.swap(generation.nextDirty);
+      std::fill(generation.nextDirty.begin(), generation.nextDirty.end(), 0);
+      resolved = runPass(generation, pass);
+      if (!resolved && !previous && pass > lastDecided) {
+         break;
+      }
+      previous = resolved;
+   }
+
+   u64 wins = 0;
+   u64 losses = 0;
+   u64 draws = 0;
+   u8 longest = 0;
+   for (u32 i = 0; i < slot.size; i++) {
+      u8 value = generation.values[i];
+      if (value == TABLEBASE_INVALID) {
+         continue;
+      }
+      wins += valueOutcome(value) == TABLEBASE_WIN;
+      losses += valueOutcome(value) == TABLEBASE_LOSS;
+      draws += valueOutcome(value) == TABLEBASE_DRAWN;
+      if (value && value - 1 > longest) {
+         longest = value - 1;
+      }
+   }
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   printf("%-6s %10u positions  %10llu wins  %10llu losses  %10llu draws  longest mate %3d plies  %3d passes  %7.2fs\n",
+      name, slot.size, (unsigned long long)wins, (unsigned long long)losses, (unsigned long long)draws, longest, pass, seconds);
+
+   if (!writeTablebase(slot, path)) {
+      fprintf(stderr, "can't write %s\n", path);
+      return false;
+   }
+   return true;
+}
+
+// Prints the position's result and plays it out, the winner mating as fast as it can and the loser holding on
+// as long as it can.
+int show(const char* fen) {
+   Board board;
+   if (!loadFen(board, fen)) {
+      fprintf(stderr, "invalid fen: %s\n", fen);
+      return 2;
+   }
+   TablebaseOutcome outcome;
+   u8 plies;
+   if (!probeTablebase(tablebases, board, outcome, plies)) {
+      fprintf(stderr, "no table for %s\n", fen);
+      return 1;
+   }
+   const char* NAMES[] = { "draw", "win", "loss" };
+   printf("%s", NAMES[outcome]);
+   if (outcome != TABLEBASE_DRAWN) {
+      printf(", mate in %d plies", plies);
+   }
+   printf("\n");
+
+   for (u16 ply = 0; ply < 300 && (outcome != TABLEBASE_DRAWN || ply < 20); ply++) {
+      MoveList moves;
+      calculateLegalMoves(board, moves);
+      Move best = MOVE_NONE;
+      s16 bestScore = -1000;
+      for (u16 i = 0; i < moves.size; i++) {
+         Board after = board;
+         Undo undo;
+         makeMove(after, moves.moves[i], undo);
+         TablebaseOutcome reply;
+         u8 replyPlies;
+         if (!probeTablebase(tablebases, after, reply, replyPlies)) {
+            continue;
+         }
+         // Ours is the negation of theirs: quick wins first, then draws, then slow losses.
+         s16 score = (reply == TABLEBASE_LOSS) ? 500 - replyPlies : (reply == TABLEBASE_WIN) ? -500 + replyPlies : 0;
+         if (score > bestScore) {
+            bestScore = score;
+            best = moves.moves[i];
+         }
+      }
+      if (!best) {
+         break;
+      }
+      char text[6];
+      printf("%s ", moveToString(best, text));
+      Undo undo;
+      makeMove(board, best, undo);
+   }
+   printf("\n");
+   return 0;
+}
+
+int main(int argc, char* argv[]) {
+   const char* fen = NULL;
+   int threads = std::thread::hardware_concurrency();
+   int i = 1;
+   for (; i < argc && argv[i][0] == '-'; i++) {
+      if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+         directory = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         threads = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+         fen = argv[++i];
+      }
+      else {
+         fprintf(stderr, "usage: %s [-o directory] [-t threads] [name...]\n       %s -o directory -f fen\n", argv[0], argv[0]);
+         return 2;
+      }
+   }
+   threadCount = (threads < 1) ? 1 : (threads > 255) ? 255 : threads;
+
+   initBitboards();
+   initZobrist();
+   for (u8 pawns = 0; pawns < 2; pawns++) {
+      for (u8 square = 0; square < 64; square++) {
+         s8 kingClass = tablebaseKingClass(square, pawns);
+         if (kingClass >= 0) {
+            kingSquares[pawns][kingClass] = square;
+         }
+      }
+   }
+
+   if (fen) {
+      loadTablebases(tablebases, directory);
+      return show(fen);
+   }
+
+   mkdir(directory, 0755);
+   const char* DEFAULT_NAMES[] = { "KQK", "KRK", "KBK", "KNK", "KPK" };
+   int count = (i < argc) ? argc - i : 5;
+   for (int n = 0; n < count; n++) {
+      if (!generate((i < argc) ? argv[i + n] : DEFAULT_NAMES[n])) {
+         return 1;
+      }
+   }
+   return 0;
+}
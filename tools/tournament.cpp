@@ -0,0 +1,523 @@
+// Plays two engine settings against each other on every core, for tuning.
+//
+// tournament -a <engine> -b <engine> [-n games] [-t threads] [-o openings] [-T directory] [-p games.pgn]
+//            [-s summary.txt] [-e elo0,elo1]
+//
+// An engine is a comma separated list of settings: nodes=N and depth=N limit every move, time=N gives it N
+// milliseconds a move, hash=N sets its transposition table's megabytes (DEFAULT_TABLE_MB) and mcts=N plays with
+// the Monte Carlo tree search and N playouts a move instead of alpha-beta, with a node pool of pool=N megabytes
+// (DEFAULT_POOL_MB). Every worker thread owns its own pair of engines, tables and pools included, and plays one
+// game at a time.
+//
+// Games start from the openings file in turn, each one played twice with the colors swapped. The file is a FEN
+// per line, or a PGN whose games end in the positions to start from. Without one every game starts from the
+// start position. Besides mate, stalemate, repetition, the fifty move rule and bare kings, games are adjudicated
+// as a win once both engines agree on a score of at least RESIGN_SCORE for RESIGN_MOVES moves each, as a draw once
+// both are within DRAW_SCORE for DRAW_MOVES moves each after DRAW_MIN_PLY, by tablebases (-T), and as a draw after
+// MAX_GAME_PLIES.
+//
+// After every game the score of a against b gives an Elo estimate with 95% error bars, and a sequential
+// probability ratio test of elo0 against elo1 (default 0,5) stops the run early once either is accepted.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "engine/parallel.h"
+#include "engine/mcts.h"
+#include "engine/pgn.h"
+
+#define DEFAULT_GAMES 100
+#define DEFAULT_TABLE_MB 16
+#define DEFAULT_POOL_MB 16
+#define MAX_GAME_PLIES 400
+#define RESIGN_SCORE 800
+#define RESIGN_MOVES 4
+#define DRAW_SCORE 10
+#define DRAW_MOVES 8
+#define DRAW_MIN_PLY 80
+// Nodes searched between looks at the clock
+#define NODES_PER_CHECK 1024
+// Chance of accepting elo1 when elo0 is true, and the other way around
+#define SPRT_ALPHA 0.05
+#define SPRT_BETA 0.05
+
+struct EngineSettings {
+   const char* name;
+   u8 depth;
+   u64 nodes;
+   u32 milliseconds;
+   u32 tableMegabytes;
+   u64 playouts;
+   // Monte Carlo node pool
+   u32 poolMegabytes;
+};
+
+// One side of a worker's games
+struct Engine {
+   const EngineSettings* settings;
+   ParallelSearch search;
+   TranspositionTable table;
+   Mcts mcts;
+};
+
+enum GameResult : u8 { RESULT_LOSS, RESULT_DRAW, RESULT_WIN };
+
+std::vector<Board> openings;
+TablebaseSet tablebases;
+EngineSettings engines[2];
+u32 gameCount = DEFAULT_GAMES;
+double elo0 = 0;
+double elo1 = 5;
+
+u32 nextGame = 0;
+// Set once the test has decided, so no new games are started
+bool decided = false;
+
+std::mutex resultsMutex;
+FILE* pgnFile = NULL;
+// [GameResult], from a's side
+u32 results[3];
+u32 adjudications = 0;
+u32 gamesPlayed = 0;
+
+bool parseEngine(char* text, EngineSettings &settings) {
+   settings.name = strdup(text);
+   settings.depth = 0;
+   settings.nodes = 0;
+   settings.milliseconds = 0;
+   settings.tableMegabytes = DEFAULT_TABLE_MB;
+   settings.playouts = 0;
+   settings.poolMegabytes = DEFAULT_POOL_MB;
+   for (char* setting = strtok(text, ","); setting; setting = strtok(NULL, ",")) {
+      char* value = strchr(setting, '=');
+      if (!value) {
+         return false;
+      }
+      *value++ = '\0';
+      u64 number = strtoull(value, NULL, 10);
+      if (!strcmp(setting, "nodes")) {
+         settings.nodes = number;
+      }
+      else if (!strcmp(setting, "depth")) {
+         settings.depth = (number >= MAX_PLY) ? MAX_PLY - 1 : number;
+      }
+      else if (!strcmp(setting, "time")) {
+         settings.milliseconds = number;
+      }
+      else if (!strcmp(setting, "hash")) {
+         settings.tableMegabytes = number;
+      }
+      else if (!strcmp(setting, "mcts")) {
+         settings.playouts = number;
+      }
+      else if (!strcmp(setting, "pool")) {
+         settings.poolMegabytes = number;
+      }
+      else {
+         return false;
+      }
+   }
+   // Something has to end the search.
+   return settings.depth || settings.nodes || settings.milliseconds || settings.playouts;
+}
+
+bool initEngine(Engine &engine, const EngineSettings &settings) {
+   engine.settings = &settings;
+   engine.mcts.nodes = NULL;
+   if (settings.playouts) {
+      return initMcts(engine.mcts, settings.poolMegabytes ? settings.poolMegabytes : 1);
+   }
+   bool table = settings.tableMegabytes && initTable(engine.table, settings.tableMegabytes);
+   if (!initParallelSearch(engine.search, 1, table ? &engine.table : NULL)) {
+      return false;
+   }
+   setParallelTablebases(engine.search, &tablebases);
+   return true;
+}
+
+// Picks the engine's move and the score it gives the position, from its side. Monte Carlo scores are 0, so
+// they never adjudicate.
+Move think(Engine &engine, const Board &board, const PositionHistory &history, u64 seed, s16 &score) {
+   const EngineSettings &settings = *engine.settings;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   score = 0;
+   if (settings.playouts) {
+      startMcts(engine.mcts, board, settings.playouts, seed);
+      while (!continueMcts(engine.mcts, 16)) {
+         if (settings.milliseconds && std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(settings.milliseconds)) {
+            stopMcts(engine.mcts);
+         }
+      }
+      return bestMctsMove(engine.mcts);
+   }
+
+   startParallelSearch(engine.search, board, history, settings.depth, settings.nodes);
+   while (!continueParallelSearch(engine.search, NODES_PER_CHECK)) {
+      if (settings.milliseconds && std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(settings.milliseconds)) {
+         stopParallelSearch(engine.search);
+      }
+   }
+   Search &search = mainSearch(engine.search);
+   score = search.score;
+   return search.bestMove;
+}
+
+// Plays one game, with the first engine as white if aWhite, and returns its result from a's side. The game is
+// written to the PGN file.
+GameResult playGame(Engine (&players)[2], u32 index, const Board &opening, bool aWhite) {
+   Board board = opening;
+   PositionHistory history;
+   clearHistory(history);
+   pushPosition(history, board.key);
+   Move moves[MAX_GAME_PLIES];
+   u16 count = 0;
+   // [color], moves in a row each side's engine has had white ahead (counting up) or behind (counting down) by
+   // RESIGN_SCORE, and within DRAW_SCORE
+   s8 resignMoves[2] = { 0, 0 };
+   u8 drawMoves[2] = { 0, 0 };
+   // Which color won, or -1 for a draw
+   s8 winner = -1;
+   const char* termination = NULL;
+   while (!termination) {
+      Legality legality;
+      calculateLegality(board, board.turn, legality);
+      TablebaseOutcome outcome;
+      u8 plies;
+      Outcome ending = gameOutcome(board, legality);
+      if (ending == checkmate) {
+         winner = !board.turn;
+         termination = "checkmate";
+      }
+      else if (ending == stalemate) {
+         termination = "stalemate";
+      }
+      else if (repetitions(history, board) >= 2) {
+         termination = "threefold repetition";
+      }
+      else if (board.halfmoveClock >= 100) {
+         termination = "fifty move rule";
+      }
+      else if (insufficientMaterial(board)) {
+         termination = "insufficient material";
+      }
+      else if (tablebases.count && probeTablebase(tablebases, board, outcome, plies)) {
+         winner = (outcome == TABLEBASE_DRAWN) ? -1 : (outcome == TABLEBASE_WIN) ? (s8)board.turn : (s8)!board.turn;
+         termination = "adjudication: tablebase";
+      }
+      else if (resignMoves[white] >= RESIGN_MOVES && resignMoves[black] >= RESIGN_MOVES) {
+         winner = white;
+         termination = "adjudication: resignation";
+      }
+      else if (resignMoves[white] <= -RESIGN_MOVES && resignMoves[black] <= -RESIGN_MOVES) {
+         winner = black;
+         termination = "adjudication: resignation";
+      }
+      else if (drawMoves[white] >= DRAW_MOVES && drawMoves[black] >= DRAW_MOVES && count >= DRAW_MIN_PLY) {
+         termination = "adjudication: draw";
+      }
+      else if (count >= MAX_GAME_PLIES) {
+         termination = "adjudication: move limit";
+      }
+      if (termination) {
+         break;
+      }
+
+      Color mover = board.turn;
+      Engine &engine = players[(mover == white) != aWhite];
+      s16 score;
+      Move move = think(engine, board, history, (u64)index << 16 | count, score);
+      if (!move) {
+         termination = "no move";
+         break;
+      }
+      s16 whiteScore = (mover == white) ? score : -score;
+      s8 &resign = resignMoves[mover];
+      resign = (whiteScore >= RESIGN_SCORE) ? ((resign > 0) ? resign + 1 : 1)
+         : (whiteScore <= -RESIGN_SCORE) ? ((resign < 0) ? resign - 1 : -1) : 0;
+      drawMoves[mover] = (abs(whiteScore) <= DRAW_SCORE && !engine.settings->playouts) ? drawMoves[mover] + 1 : 0;
+
+      Undo undo;
+      makeMove(board, move, undo);
+      pushPosition(history, board.key);
+      moves[count++] = move;
+   }
+   bool adjudicated = !strncmp(termination, "adjudication", 12);
+
+   const char* resultText = (winner == white) ? "1-0" : (winner == black) ? "0-1" : "1/2-1/2";
+   GameResult result = (winner < 0) ? RESULT_DRAW : ((winner == white) == aWhite) ? RESULT_WIN : RESULT_LOSS;
+
+   char round[16];
+   snprintf(round, sizeof(round), "%u", index + 1);
+   PgnTags tags;
+   initPgnTags(tags);
+   tags.event = "chess3DS tournament";
+   tags.round = round;
+   tags.white = engines[!aWhite].name;
+   tags.black = engines[aWhite].name;
+   tags.termination = termination;
+   std::lock_guard<std::mutex> lock(resultsMutex);
+   if (pgnFile) {
+      writePgn(pgnFile, tags, opening, moves, count, resultText);
+   }
+   adjudications += adjudicated;
+   return result;
+}
+
+// Expected score of a player that many Elo points stronger
+inline double expectedScore(double elo) {
+   return 1 / (1 + pow(10, -elo / 400));
+}
+
+inline double scoreToElo(double score) {
+   return -400 * log10(1 / score - 1);
+}
+
+// Log-likelihood ratio of elo1 against elo0, from the normal approximation of the game results.
+double sprtRatio(const u32 (&counts)[3]) {
+   u32 games = counts[RESULT_LOSS] + counts[RESULT_DRAW] + counts[RESULT_WIN];
+   if (!games || !counts[RESULT_WIN] + !counts[RESULT_LOSS] + !counts[RESULT_DRAW] > 1) {
+      return 0;
+   }
+   double score = (counts[RESULT_WIN] + 0.5 * counts[RESULT_DRAW]) / games;
+   double variance = (counts[RESULT_WIN] * pow(1 - score, 2) + counts[RESULT_DRAW] * pow(0.5 - score, 2)
+      + counts[RESULT_LOSS] * pow(score, 2)) / games;
+   double score0 = expectedScore(elo0);
+   double score1 = expectedScore(elo1);
+   return (score1 - score0) * (2 * score - score0 - score1) / (2 * variance) * games;
+}
+
+// Elo of a against b with the 95% interval, from the score and its standard error.
+void eloEstimate(const u32 (&counts)[3], double &elo, double &margin) {
+   u32 games = counts[RESULT_LOSS] + counts[RESULT_DRAW] + counts[RESULT_WIN];
+   double score = (counts[RESULT_WIN] + 0.5 * counts[RESULT_DRAW]) / games;
+   double variance = (counts[RESULT_WIN] * pow(1 - score, 2) + counts[RESULT_DRAW] * pow(0.5 - score, 2)
+      + counts[RESULT_LOSS] * pow(score, 2)) / games;
+   double error = sqrt(variance / games);
+   double clamp = 0.5 / games;
+   double low = fmax(clamp, fmin(1 - clamp, score - 1.96 * error));
+   double high = fmax(clamp, fmin(1 - clamp, score + 1.96 * error));
+   elo = scoreToElo(fmax(clamp, fmin(1 - clamp, score)));
+   margin = (scoreToElo(high) - scoreToElo(low)) / 2;
+}
+
+void worker() {
+   Engine players[2];
+   if (!initEngine(players[0], engines[0]) || !initEngine(players[1], engines[1])) {
+      fprintf(stderr, "not enough memory for the engines\n");
+      exit(1);
+   }
+   double lower = log(SPRT_BETA / (1 - SPRT_ALPHA));
+   double upper = log((1 - SPRT_BETA) / SPRT_ALPHA);
+   u32 index;
+   while (!__atomic_load_n(&decided, __ATOMIC_RELAXED) && (index = __atomic_fetch_add(&nextGame, 1, __ATOMIC_RELAXED)) < gameCount) {
+      const Board &opening = openings[(index / 2) % openings.size()];
+      GameResult result = playGame(players, index, opening, !(index & 1));
+
+      std::lock_guard<std::mutex> lock(resultsMutex);
+      results[result]++;
+      gamesPlayed++;
+      double ratio = sprtRatio(results);
+      if (ratio <= lower || ratio >= upper) {
+         __atomic_store_n(&decided, true, __ATOMIC_RELAXED);
+      }
+      if (gamesPlayed % 10 == 0) {
+         printf("%u games  +%u =%u -%u  llr %.2f [%.2f, %.2f]\n", gamesPlayed, results[RESULT_WIN], results[RESULT_DRAW],
+            results[RESULT_LOSS], ratio, lower, upper);
+      }
+   }
+   for (u8 i = 0; i < 2; i++) {
+      if (players[i].mcts.nodes) {
+         freeMcts(players[i].mcts);
+      }
+      else {
+         freeParallelSearch(players[i].search);
+         if (players[i].search.table) {
+            freeTable(players[i].table);
+         }
+      }
+   }
+}
+
+// Reads a FEN per line, or the end positions of a PGN's games.
+bool readOpenings(const char* path) {
+   FILE* file = fopen(path, "r");
+   if (!file) {
+      fprintf(stderr, "can't open %s\n", path);
+      return false;
+   }
+   size_t length = strlen(path);
+   if (length > 4 && !strcmp(path + length - 4, ".pgn")) {
+      PgnReader reader;
+      initPgnReader(reader, file);
+      Board board;
+      setupStartPosition(board);
+      bool moved = false;
+      // A game whose FEN isn't a legal position is skipped.
+      bool valid = true;
+      PgnToken token;
+      while ((token = nextPgnToken(reader)) != PGN_END) {
+         if (token == PGN_TAG && !strcmp(reader.tag, "FEN")) {
+            valid = loadFen(board, reader.text);
+            if (!valid) {
+               fprintf(stderr, "skipping an opening with an invalid FEN: %s\n", reader.text);
+            }
+         }
+         else if (!valid) {
+            if (token == PGN_RESULT) {
+               setupStartPosition(board);
+               moved = false;
+               valid = true;
+            }
+         }
+         else if (token == PGN_MOVE) {
+            MoveList moves;
+            calculateLegalMoves(board, moves);
+            Move move = parseSan(board, moves, reader.text);
+            if (move) {
+               Undo undo;
+               makeMove(board, move, undo);
+               moved = true;
+            }
+         }
+         else if (token == PGN_RESULT) {
+            openings.push_back(board);
+            setupStartPosition(board);
+            moved = false;
+         }
+      }
+      if (moved && valid) {
+         openings.push_back(board);
+      }
+   }
+   else {
+      char line[256];
+      while (fgets(line, sizeof(line), file)) {
+         Board board;
+         if (line[0] != '#' && loadFen(board, line)) {
+            openings.push_back(board);
+         }
+      }
+   }
+   fclose(file);
+   if (openings.empty()) {
+      fprintf(stderr, "no openings in %s\n", path);
+      return false;
+   }
+   return true;
+}
+
+int main(int argc, char* argv[]) {
+   int threads = std::thread::hardware_concurrency();
+   const char* openingsPath = NULL;
+   const char* tablebaseDirectory = NULL;
+   const char* pgnPath = "tournament.pgn";
+   const char* summaryPath = "tournament.txt";
+   bool engineSet[2] = { false, false };
+   bool valid = true;
+   for (int i = 1; i < argc && valid; i++) {
+      if ((!strcmp(argv[i], "-a") || !strcmp(argv[i], "-b")) && i + 1 < argc) {
+         u8 side = argv[i][1] == 'b';
+         valid = parseEngine(argv[++i], engines[side]);
+         engineSet[side] = true;
+      }
+      else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+         gameCount = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         threads = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+         openingsPath = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-T") && i + 1 < argc) {
+         tablebaseDirectory = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+         pgnPath = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+         summaryPath = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+         valid = sscanf(argv[++i], "%lf,%lf", &elo0, &elo1) == 2 && elo0 < elo1;
+      }
+      else {
+         valid = false;
+      }
+   }
+   if (!valid || !engineSet[0] || !engineSet[1] || !gameCount) {
+      fprintf(stderr, "usage: %s -a engine -b engine [-n games] [-t threads] [-o openings] [-T directory] [-p games.pgn]\n"
+         "          [-s summary.txt] [-e elo0,elo1]\n"
+         "engine: nodes=N,depth=N,time=ms,hash=MB,mcts=playouts,pool=MB (comma separated; pool sizes the mcts nodes)\n", argv[0]);
+      return 2;
+   }
+   u8 threadCount = (threads < 1) ? 1 : (threads > 255) ? 255 : threads;
+
+   initBitboards();
+   initZobrist();
+   if (openingsPath) {
+      if (!readOpenings(openingsPath)) {
+         return 1;
+      }
+   }
+   else {
+      Board board;
+      setupStartPosition(board);
+      openings.push_back(board);
+   }
+   if (tablebaseDirectory) {
+      printf("%d tablebases loaded\n", loadTablebases(tablebases, tablebaseDirectory));
+   }
+   pgnFile = fopen(pgnPath, "w");
+   if (!pgnFile) {
+      fprintf(stderr, "can't write %s\n", pgnPath);
+      return 1;
+   }
+   printf("%s vs %s, %u games on %u threads, %u openings\n", engines[0].name, engines[1].name, gameCount, threadCount,
+      (u32)openings.size());
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   std::thread helpers[256];
+   for (u8 t = 1; t < threadCount; t++) {
+      helpers[t] = std::thread(worker);
+   }
+   worker();
+   for (u8 t = 1; t < threadCount; t++) {
+      helpers[t].join();
+   }
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   fclose(pgnFile);
+
+   double elo = 0;
+   double margin = 0;
+   if (gamesPlayed) {
+      eloEstimate(results, elo, margin);
+   }
+   double ratio = sprtRatio(results);
+   double lower = log(SPRT_BETA / (1 - SPRT_ALPHA));
+   double upper = log((1 - SPRT_BETA) / SPRT_ALPHA);
+   const char* verdict = (ratio >= upper) ? "H1 accepted" : (ratio <= lower) ? "H0 accepted" : "inconclusive";
+
+   FILE* summary = fopen(summaryPath, "w");
+   if (!summary) {
+      fprintf(stderr, "can't write %s\n", summaryPath);
+      return 1;
+   }
+   FILE* outputs[2] = { stdout, summary };
+   for (u8 i = 0; i < 2; i++) {
+      fprintf(outputs[i], "a: %s\nb: %s\n", engines[0].name, engines[1].name);
+      fprintf(outputs[i], "games %u  wins %u  draws %u  losses %u  adjudicated %u\n", gamesPlayed, results[RESULT_WIN],
+         results[RESULT_DRAW], results[RESULT_LOSS], adjudications);
+      fprintf(outputs[i], "score %.1f%%  elo %+.1f +/- %.1f\n", gamesPlayed ? 100.0 * (results[RESULT_WIN] + 0.5 * results[RESULT_DRAW]) / gamesPlayed : 0.0,
+         elo, margin);
+      fprintf(outputs[i], "sprt elo0 %.1f elo1 %.1f  llr %.2f [%.2f, %.2f]  %s\n", elo0, elo1, ratio, lower, upper, verdict);
+      fprintf(outputs[i], "time %.1fs  %.2f games/s on %u threads\n", seconds, gamesPlayed / seconds, threadCount);
+   }
+   fclose(summary);
+   return 0;
+}
@@ -0,0 +1,326 @@
+// The engine behind the Universal Chess Interface, for chess GUIs and match runners.
+//
+// uci                  reads commands from stdin and answers on stdout. Supported: uci, isready, ucinewgame,
+//                      setoption (Hash, Threads, TablebasePath), position (startpos or fen, then moves), go
+//                      (depth, nodes, movetime, wtime, btime, winc, binc, movestogo, infinite), stop and quit.
+//
+// The search runs on its own thread so stop can come in while it thinks. It prints an info line with the score,
+// node count, nodes per second and principal variation after every completed iteration.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#include "engine/parallel.h"
+#include "engine/fen.h"
+
+#define DEFAULT_TABLE_MB 64
+#define MAX_TABLE_MB 4096
+// Longest command line read
+#define MAX_COMMAND 65536
+// Nodes the main search gets through between looks at the clock and the stop flag
+#define NODES_PER_CHECK 4096
+// Milliseconds kept back from every move for talking to the GUI
+#define MOVE_OVERHEAD_MS 30
+// Moves the remaining time is shared between when the GUI doesn't say
+#define DEFAULT_MOVES_TO_GO 30
+
+struct GoLimits {
+   u8 depth;
+   u64 nodes;
+   // Milliseconds to stop after, 0 for none
+   u64 time;
+   bool infinite;
+};
+
+ParallelSearch parallel;
+TranspositionTable table;
+TablebaseSet tablebases;
+u32 tableMegabytes = DEFAULT_TABLE_MB;
+u8 threadCount = 1;
+
+Board board;
+PositionHistory history;
+
+std::thread searcher;
+bool searching = false;
+// Set by the main thread, read by the searcher with atomic operations
+bool stopRequested = false;
+
+// Walks the table from the position to the line the search expects, checking every move is legal.
+u8 principalVariation(const Board &start, Move best, Move (&line)[MAX_PLY]) {
+   Board position = start;
+   u8 length = 0;
+   Move move = best;
+   TableStats stats;
+   while (move && length < MAX_PLY) {
+      MoveList moves;
+      calculateLegalMoves(position, moves);
+      bool legal = false;
+      for (u16 i = 0; i < moves.size && !legal; i++) {
+         legal = moves.moves[i] == move;
+      }
+      if (!legal) {
+         break;
+      }
+      line[length++] = move;
+      Undo undo;
+      makeMove(position, move, undo);
+      TableEntry entry;
+      move = (parallel.table && probeTable(*parallel.table, position.key, entry, stats)) ? entry.move : MOVE_NONE;
+   }
+   return length;
+}
+
+void printInfo(Search &search, double seconds) {
+   u64 nodes = parallelNodes(parallel);
+   char score[32];
+   if (search.score >= MATE_BOUND) {
+      snprintf(score, sizeof(score), "mate %d", (MATE_SCORE - search.score + 1) / 2);
+   }
+   else if (search.score <= -MATE_BOUND) {
+      snprintf(score, sizeof(score), "mate -%d", (MATE_SCORE + search.score) / 2);
+   }
+   else {
+      snprintf(score, sizeof(score), "cp %d", search.score);
+   }
+   printf("info depth %d score %s nodes %llu nps %.0f time %.0f", search.completedDepth, score, (unsigned long long)nodes,
+      seconds > 0 ? nodes / seconds : 0.0, seconds * 1000);
+   if (parallel.table) {
+      printf(" hashfull %d", tableFill(*parallel.table));
+   }
+   if (tablebases.count) {
+      printf(" tbhits %llu", (unsigned long long)search.tablebaseHits);
+   }
+   Move line[MAX_PLY];
+   u8 length = principalVariation(board, search.bestMove, line);
+   if (length) {
+      printf(" pv");
+      for (u8 i = 0; i < length; i++) {
+         char text[6];
+         printf(" %s", moveToString(line[i], text));
+      }
+   }
+   printf("\n");
+}
+
+void searchThread(GoLimits limits) {
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   startParallelSearch(parallel, board, history, limits.depth, limits.nodes);
+   Search &search = mainSearch(parallel);
+   u8 reported = 0;
+   bool finished = false;
+   while (!finished) {
+      finished = continueParallelSearch(parallel, NODES_PER_CHECK);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (search.completedDepth != reported) {
+         reported = search.completedDepth;
+         printInfo(search, seconds);
+         // The next iteration takes longer than all the ones before it, so it isn't started without the time.
+         if (limits.time && seconds * 2000 > limits.time) {
+            break;
+         }
+      }
+      if (__atomic_load_n(&stopRequested, __ATOMIC_RELAXED) || (limits.time && seconds * 1000 >= limits.time)) {
+         break;
+      }
+   }
+   stopParallelSearch(parallel);
+
+   // Under go infinite the move is only given once the GUI asks for it.
+   while (limits.infinite && !__atomic_load_n(&stopRequested, __ATOMIC_RELAXED)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   char text[6];
+   printf("bestmove %s\n", search.bestMove ? moveToString(search.bestMove, text) : "0000");
+}
+
+void stopSearching() {
+   if (!searching) {
+      return;
+   }
+   __atomic_store_n(&stopRequested, true, __ATOMIC_RELAXED);
+   searcher.join();
+   searching = false;
+}
+
+// (Re)allocates the table and the searches after a change of size or threads.
+void initSearch() {
+   if (parallel.searches) {
+      freeParallelSearch(parallel);
+   }
+   if (table.buckets) {
+      freeTable(table);
+   }
+   if (!initTable(table, tableMegabytes)) {
+      printf("info string can't allocate a %u MB table, searching without one\n", tableMegabytes);
+   }
+   if (!initParallelSearch(parallel, threadCount, table.buckets ? &table : NULL)) {
+      fprintf(stderr, "not enough memory for %u threads\n", threadCount);
+      exit(1);
+   }
+   setParallelTablebases(parallel, &tablebases);
+}
+
+// Returns where the word is in the command, or NULL.
+const char* findWord(const char* text, const char* word) {
+   size_t length = strlen(word);
+   for (const char* found = strstr(text, word); found; found = strstr(found + 1, word)) {
+      if ((found == text || found[-1] == ' ') && (found[length] == ' ' || !found[length])) {
+         return found;
+      }
+   }
+   return NULL;
+}
+
+// Returns what follows the word, or NULL.
+const char* wordAfter(const char* text, const char* word) {
+   const char* found = findWord(text, word);
+   return (found && found[strlen(word)]) ? found + strlen(word) + 1 : NULL;
+}
+
+u64 numberAfter(const char* text, const char* word) {
+   const char* value = wordAfter(text, word);
+   return value ? strtoull(value, NULL, 10) : 0;
+}
+
+void setOption(const char* command) {
+   const char* name = wordAfter(command, "name");
+   const char* value = wordAfter(command, "value");
+   if (!name) {
+      return;
+   }
+   if (!strncmp(name, "Hash ", 5) && value) {
+      u64 megabytes = strtoull(value, NULL, 10);
+      tableMegabytes = (megabytes < 1) ? 1 : (megabytes > MAX_TABLE_MB) ? MAX_TABLE_MB : megabytes;
+      initSearch();
+   }
+   else if (!strncmp(name, "Threads ", 8) && value) {
+      u64 threads = strtoull(value, NULL, 10);
+      threadCount = (threads < 1) ? 1 : (threads > MAX_THREADS) ? MAX_THREADS : threads;
+      initSearch();
+   }
+   else if (!strncmp(name, "TablebasePath ", 14) && value) {
+      closeTablebases(tablebases);
+      printf("info string %u tablebases loaded\n", loadTablebases(tablebases, value));
+   }
+   else {
+      printf("info string unknown option\n");
+   }
+}
+
+void setPosition(const char* command) {
+   const char* fen = wordAfter(command, "fen");
+   if (!loadFen(board, fen ? fen : START_FEN)) {
+      printf("info string invalid fen\n");
+      loadFen(board, START_FEN);
+   }
+   clearHistory(history);
+   pushPosition(history, board.key);
+
+   const char* moves = wordAfter(command, "moves");
+   while (moves && *moves) {
+      char text[8];
+      u8 length = 0;
+      for (; *moves && *moves != ' '; moves++) {
+         if (length < sizeof(text) - 1) {
+            text[length++] = *moves;
+         }
+      }
+      text[length] = '\0';
+      while (*moves == ' ') {
+         moves++;
+      }
+      MoveList moveList;
+      calculateLegalMoves(board, moveList);
+      Move move = stringToMove(moveList, text);
+      if (!move) {
+         printf("info string illegal move %s\n", text);
+         return;
+      }
+      Undo undo;
+      makeMove(board, move, undo);
+      pushPosition(history, board.key);
+   }
+}
+
+void go(const char* command) {
+   GoLimits limits;
+   u64 depth = numberAfter(command, "depth");
+   limits.depth = (depth >= MAX_PLY) ? MAX_PLY - 1 : depth;
+   limits.nodes = numberAfter(command, "nodes");
+   limits.time = numberAfter(command, "movetime");
+   limits.infinite = findWord(command, "infinite");
+   u64 clock = numberAfter(command, (board.turn == white) ? "wtime" : "btime");
+   if (!limits.time && clock) {
+      // An even share of what's left, plus most of the increment, never all of the clock.
+      u64 movesToGo = numberAfter(command, "movestogo");
+      u64 increment = numberAfter(command, (board.turn == white) ? "winc" : "binc");
+      limits.time = clock / (movesToGo ? movesToGo : DEFAULT_MOVES_TO_GO) + increment * 3 / 4;
+      if (limits.time > clock / 2) {
+         limits.time = clock / 2;
+      }
+   }
+   if (limits.time) {
+      limits.time = (limits.time > 2 * MOVE_OVERHEAD_MS) ? limits.time - MOVE_OVERHEAD_MS : limits.time / 2 + 1;
+   }
+   if (limits.infinite) {
+      limits.time = 0;
+   }
+
+   stopRequested = false;
+   searching = true;
+   searcher = std::thread(searchThread, limits);
+}
+
+int main() {
+   setvbuf(stdout, NULL, _IOLBF, 0);
+   initBitboards();
+   initZobrist();
+   initSearch();
+   loadFen(board, START_FEN);
+   clearHistory(history);
+   pushPosition(history, board.key);
+
+   static char command[MAX_COMMAND];
+   while (fgets(command, sizeof(command), stdin)) {
+      command[strcspn(command, "\r\n")] = '\0';
+      if (!strcmp(command, "uci")) {
+         printf("id name chess3DS\nid author the chess3DS authors\n");
+         printf("option name Hash type spin default %d min 1 max %d\n", DEFAULT_TABLE_MB, MAX_TABLE_MB);
+         printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+         printf("option name TablebasePath type string default <empty>\n");
+         printf("uciok\n");
+      }
+      else if (!strcmp(command, "isready")) {
+         printf("readyok\n");
+      }
+      else if (!strcmp(command, "ucinewgame")) {
+         stopSearching();
+         if (parallel.table) {
+            clearTable(table);
+         }
+      }
+      else if (!strncmp(command, "setoption", 9)) {
+         stopSearching();
+         setOption(command);
+      }
+      else if (!strncmp(command, "position", 8)) {
+         stopSearching();
+         setPosition(command);
+      }
+      else if (!strncmp(command, "go", 2)) {
+         stopSearching();
+         go(command);
+      }
+      else if (!strcmp(command, "stop")) {
+         stopSearching();
+      }
+      else if (!strcmp(command, "quit")) {
+         break;
+      }
+   }
+   stopSearching();
+   return 0;
+}
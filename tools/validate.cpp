@@ -0,0 +1,263 @@
+// Replays PGN games through the rules and reports the ones that break them.
+//
+// validate [-t threads] <pgn>...
+//                      every game of every file. A game is invalid if a move can't be played (illegal,
+//                      ambiguous or unreadable), a move comes after mate or stalemate, the result contradicts
+//                      the final mate or stalemate or the Result tag, the FEN tag can't be read, or the result
+//                      is missing. Exits with 1 if any game is invalid.
+//
+// Files are cut into parts at "[Event" lines, and the threads take parts as they finish the last, each reading
+// its part straight from the file. Errors are printed once everything has been read, in file order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine/pgn.h"
+
+// Size of the parts files are cut into
+#define PART_SIZE (4 << 20)
+
+struct ValidationError {
+   // Line in the part
+   u32 line;
+   std::string message;
+};
+
+struct Part {
+   const char* path;
+   u64 start;
+   u64 end;
+   u64 games;
+   u64 moves;
+   u64 invalid;
+   // Lines the part spans, to turn the lines of its errors into lines of the file
+   u32 lines;
+   std::vector<ValidationError> errors;
+};
+
+std::vector<Part> parts;
+u32 nextPart = 0;
+
+// Game being replayed
+struct Replay {
+   Board board;
+   u32 firstLine;
+   u16 moves;
+   bool started;
+   bool invalid;
+   Outcome outcome;
+   // Result tag, empty if there's none
+   char result[8];
+};
+
+void resetReplay(Replay &replay) {
+   setupStartPosition(replay.board);
+   replay.moves = 0;
+   replay.started = false;
+   replay.invalid = false;
+   replay.outcome = ongoing;
+   replay.result[0] = '\0';
+}
+
+void reportError(Part &part, Replay &replay, u32 line, const char* message, const char* text) {
+   if (replay.invalid) {
+      return;
+   }
+   replay.invalid = true;
+   char buffer[PGN_TEXT_SIZE + 64];
+   snprintf(buffer, sizeof(buffer), "%s%s", message, text);
+   ValidationError error = { line, buffer };
+   part.errors.push_back(error);
+}
+
+void finishGame(Part &part, Replay &replay, u32 line, const char* result) {
+   if (!result) {
+      reportError(part, replay, replay.firstLine, "game has no result", "");
+   }
+   else if (replay.result[0] && strcmp(replay.result, result) && strcmp(result, "*")) {
+      reportError(part, replay, line, "result doesn't match the Result tag ", replay.result);
+   }
+   else if (replay.outcome == checkmate && strcmp(result, (replay.board.turn == white) ? "0-1" : "1-0")) {
+      reportError(part, replay, line, "result after checkmate is ", result);
+   }
+   else if (replay.outcome == stalemate && strcmp(result, "1/2-1/2")) {
+      reportError(part, replay, line, "result after stalemate is ", result);
+   }
+   part.games++;
+   part.moves += replay.moves;
+   part.invalid += replay.invalid;
+   resetReplay(replay);
+}
+
+void validatePart(Part &part) {
+   FILE* file = fopen(part.path, "r");
+   if (!file) {
+      ValidationError error = { 1, "can't open the file" };
+      part.errors.push_back(error);
+      return;
+   }
+   fseek(file, part.start, SEEK_SET);
+   PgnReader reader;
+   initPgnReader(reader, file, part.start);
+
+   Replay replay;
+   resetReplay(replay);
+   PgnToken token;
+   while ((token = nextPgnToken(reader)) != PGN_END && reader.tokenOffset < part.end) {
+      // Tags after moves start the next game even when the result is missing.
+      if (token == PGN_TAG && replay.moves) {
+         finishGame(part, replay, reader.line, NULL);
+      }
+      if (!replay.started) {
+         replay.started = true;
+         replay.firstLine = reader.line;
+      }
+
+      if (token == PGN_TAG) {
+         if (!strcmp(reader.tag, "FEN")) {
+            if (!loadFen(replay.board, reader.text)) {
+               reportError(part, replay, reader.line, "invalid fen: ", reader.text);
+            }
+         }
+         else if (!strcmp(reader.tag, "Result") && isPgnResult(reader.text)) {
+            strcpy(replay.result, reader.text);
+         }
+      }
+      else if (token == PGN_MOVE) {
+         if (replay.invalid) {
+            continue;
+         }
+         if (replay.outcome != ongoing) {
+            reportError(part, replay, reader.line, (replay.outcome == checkmate) ? "move after checkmate: " : "move after stalemate: ", reader.text);
+            continue;
+         }
+         MoveList moves;
+         calculateLegalMoves(replay.board, moves);
+         Move move = parseSan(replay.board, moves, reader.text);
+         if (!move) {
+            reportError(part, replay, reader.line, "can't play ", reader.text);
+            continue;
+         }
+         Undo undo;
+         makeMove(replay.board, move, undo);
+         replay.moves++;
+         Legality legality;
+         calculateLegality(replay.board, replay.board.turn, legality);
+         replay.outcome = gameOutcome(replay.board, legality);
+      }
+      else {
+         finishGame(part, replay, reader.line, reader.text);
+      }
+   }
+   if (replay.started) {
+      finishGame(part, replay, reader.line, NULL);
+   }
+   part.lines = reader.line - 1;
+   fclose(file);
+}
+
+void worker() {
+   u32 index;
+   while ((index = __atomic_fetch_add(&nextPart, 1, __ATOMIC_RELAXED)) < parts.size()) {
+      validatePart(parts[index]);
+   }
+}
+
+// Returns the offset of the first "[Event" line at or after the offset, or the size if there's none.
+u64 findGameStart(FILE* file, u64 offset, u64 size) {
+   const char EVENT[] = "\n[Event";
+   fseek(file, offset - 1, SEEK_SET);
+   u8 matched = 0;
+   int c;
+   for (u64 i = offset - 1; (c = getc(file)) != EOF; i++) {
+      matched = (c == EVENT[matched]) ? matched + 1 : (c == EVENT[0]);
+      if (matched == sizeof(EVENT) - 1) {
+         return i - (sizeof(EVENT) - 3);
+      }
+   }
+   return size;
+}
+
+bool splitFile(const char* path) {
+   FILE* file = fopen(path, "r");
+   if (!file) {
+      fprintf(stderr, "can't open %s\n", path);
+      return false;
+   }
+   fseek(file, 0, SEEK_END);
+   u64 size = ftell(file);
+   u64 start = 0;
+   while (start < size) {
+      u64 end = (size - start > PART_SIZE) ? findGameStart(file, start + PART_SIZE, size) : size;
+      Part part;
+      part.path = path;
+      part.start = start;
+      part.end = end;
+      part.games = part.moves = part.invalid = 0;
+      part.lines = 0;
+      parts.push_back(part);
+      start = end;
+   }
+   fclose(file);
+   return true;
+}
+
+int main(int argc, char* argv[]) {
+   int threads = std::thread::hardware_concurrency();
+   int i = 1;
+   for (; i < argc && argv[i][0] == '-'; i++) {
+      if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         threads = atoi(argv[++i]);
+      }
+      else {
+         break;
+      }
+   }
+   if (i == argc || argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [-t threads] pgn...\n", argv[0]);
+      return 2;
+   }
+   u8 threadCount = (threads < 1) ? 1 : (threads > 255) ? 255 : threads;
+
+   initBitboards();
+   initZobrist();
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   for (; i < argc; i++) {
+      if (!splitFile(argv[i])) {
+         return 1;
+      }
+   }
+   std::thread helpers[256];
+   for (u8 t = 1; t < threadCount; t++) {
+      helpers[t] = std::thread(worker);
+   }
+   worker();
+   for (u8 t = 1; t < threadCount; t++) {
+      helpers[t].join();
+   }
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   u64 games = 0;
+   u64 moves = 0;
+   u64 invalid = 0;
+   u32 line = 0;
+   for (size_t p = 0; p < parts.size(); p++) {
+      if (p && parts[p].path != parts[p - 1].path) {
+         line = 0;
+      }
+      for (size_t e = 0; e < parts[p].errors.size(); e++) {
+         fprintf(stderr, "%s:%u: %s\n", parts[p].path, line + parts[p].errors[e].line, parts[p].errors[e].message.c_str());
+      }
+      line += parts[p].lines;
+      games += parts[p].games;
+      moves += parts[p].moves;
+      invalid += parts[p].invalid;
+   }
+   printf("%llu games, %llu moves, %llu invalid in %.2fs on %u threads: %.0f games/s, %.0f moves/s\n", (unsigned long long)games,
+      (unsigned long long)moves, (unsigned long long)invalid, seconds, threadCount, games / seconds, moves / seconds);
+   return invalid ? 1 : 0;
+}